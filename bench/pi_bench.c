@@ -0,0 +1,409 @@
+// Microbenchmarks of the series kernels, the final division and the output writer.
+//
+// Every benchmark is calibrated so one repetition runs at least --min-time seconds
+// (several calls per repetition for the fast kernels), then timed --reps times.
+// The results are written as JSON, one record per kernel, variant and size, with
+// the mean, standard deviation, minimum and maximum time per call, so the files
+// of two builds can be compared directly.
+
+#include "pi.h"
+#include "pi_internal.h"
+#include <gmp.h>
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAX_SIZES 16
+
+// A benchmarked call: fn(arg) is timed, setup(arg), if any, runs untimed before every call
+typedef struct {
+    void (*fn)(void* arg);
+    void (*setup)(void* arg);
+    void* arg;
+} BenchCall;
+
+// Timing options and the JSON output
+typedef struct {
+    int reps;
+    double min_time;
+    FILE* out;
+    int records;
+    const PiConstants* constants;
+} Bench;
+
+// State of a kernel benchmark
+typedef struct {
+    ThreadVariables var;
+    #ifdef ENABLE_CACHE
+    ThreadCache cache;
+    #endif
+    unsigned long k;
+    unsigned long block_size;
+    mpz_t fact;
+} KernelArg;
+
+// State of the division and output benchmarks
+typedef struct {
+    mpf_t pi, C, S;
+    unsigned long digits;
+    bool format_output;
+    bool raw_output;
+    DigitFormat output_format;
+    int radix;
+    FILE* sink;
+} OutputArg;
+
+// Parse a comma separated list of sizes; returns the number of sizes
+static int parse_sizes(const char* list, unsigned long* sizes) {
+    int count = 0;
+    const char* p = list;
+    while (*p && count < BENCH_MAX_SIZES) {
+        char* end;
+        unsigned long value = strtoul(p, &end, 10);
+        if (end == p) break;
+        if (value > 0) sizes[count++] = value;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+// Seconds taken by calls calls of the benchmark (setup excluded)
+static double time_calls(const BenchCall* call, long calls) {
+    double total = 0;
+    for (long i = 0; i < calls; i++) {
+        if (call->setup) call->setup(call->arg);
+        double start = omp_get_wtime();
+        call->fn(call->arg);
+        total += omp_get_wtime() - start;
+    }
+    return total;
+}
+
+// Time the call and append its record to the JSON output
+static void bench_run(Bench* bench, const char* kernel, const char* variant, unsigned long k,
+    unsigned long digits, const BenchCall* call) {
+    // Warm up, then double the calls per repetition until one repetition is long enough
+    long calls = 1;
+    double elapsed = time_calls(call, calls);
+    while (elapsed < bench->min_time && calls < (1L << 24)) {
+        calls *= 2;
+        elapsed = time_calls(call, calls);
+    }
+
+    double sum = 0, sum_sq = 0, min = 0, max = 0;
+    for (int r = 0; r < bench->reps; r++) {
+        double t = time_calls(call, calls) / calls;
+        sum += t;
+        sum_sq += t * t;
+        if (r == 0 || t < min) min = t;
+        if (r == 0 || t > max) max = t;
+    }
+    double mean = sum / bench->reps;
+    double variance = bench->reps > 1 ? (sum_sq - sum * mean) / (bench->reps - 1) : 0;
+    if (variance < 0) variance = 0;
+
+    fprintf(bench->out, "%s\n    {\"kernel\": \"%s\", \"variant\": \"%s\", \"k\": %lu, \"digits\": %lu, "
+            "\"reps\": %d, \"calls_per_rep\": %ld, \"mean_s\": %.9e, \"stddev_s\": %.9e, "
+            "\"variance_s2\": %.9e, \"min_s\": %.9e, \"max_s\": %.9e}",
+            bench->records ? "," : "", kernel, variant, k, digits, bench->reps, calls,
+            mean, sqrt(variance), variance, min, max);
+    bench->records++;
+
+    fprintf(stderr, "%-20s %-10s k=%-8lu digits=%-9lu %12.3f us +/- %.3f\n",
+            kernel, variant, k, digits, mean * 1e6, sqrt(variance) * 1e6);
+}
+
+// Initialize the kernel state for term k at prec bits
+static void kernel_init(const Bench* bench, KernelArg* arg, unsigned long k, unsigned long iterations,
+    mp_bitcnt_t prec) {
+    arg->k = k;
+    init_thread_variables(&arg->var, k, prec, bench->constants);
+    #ifdef ENABLE_PRECISION_TAPER
+    init_precision_bands(&arg->var, iterations);
+    #else
+    (void) iterations;
+    #endif
+    #ifdef ENABLE_BLOCK_FACTORIAL
+    arg->var.block_size = 8;
+    #endif
+    #ifdef ENABLE_CACHE
+    init_thread_cache(&arg->cache, k);
+    #endif
+    mpz_init(arg->fact);
+}
+
+static void kernel_clear(KernelArg* arg) {
+    clean_thread_variables(&arg->var);
+    #ifdef ENABLE_CACHE
+    clean_thread_cache(&arg->cache);
+    #endif
+    mpz_clear(arg->fact);
+}
+
+#ifdef ENABLE_CACHE
+// Fill the cache with the factorials and power of k - 1, so the next call for k is a cache hit
+static void prime_cache(KernelArg* arg) {
+    calculate_M(arg->k - 1, &arg->var, &arg->cache);
+    calculate_X(arg->k - 1, &arg->var, &arg->cache);
+    set_cache(arg->k - 1, &arg->cache, &arg->var);
+}
+
+// Forget the cache, so the next call for k computes from scratch
+static void miss_cache(KernelArg* arg) {
+    arg->cache.k_M = 0;
+    arg->cache.K_X = 0;
+}
+#endif
+
+static void run_calculate_M(void* p) {
+    KernelArg* arg = (KernelArg*) p;
+    #ifdef ENABLE_CACHE
+    calculate_M(arg->k, &arg->var, &arg->cache);
+    #else
+    calculate_M(arg->k, &arg->var);
+    #endif
+}
+
+static void run_calculate_X(void* p) {
+    KernelArg* arg = (KernelArg*) p;
+    #ifdef ENABLE_CACHE
+    calculate_X(arg->k, &arg->var, &arg->cache);
+    #else
+    calculate_X(arg->k, &arg->var);
+    #endif
+}
+
+static void run_calculate_term(void* p) {
+    KernelArg* arg = (KernelArg*) p;
+    calculate_term(arg->k, &arg->var);
+}
+
+#ifdef ENABLE_BLOCK_FACTORIAL
+// fact = k! in blocks of block_size factors
+static void setup_block_factorial(void* p) {
+    mpz_set_ui(((KernelArg*) p)->fact, 1);
+}
+
+static void run_block_factorial(void* p) {
+    KernelArg* arg = (KernelArg*) p;
+    block_factorial(1, arg->k, arg->block_size, arg->var.block_prod, arg->fact);
+}
+#endif
+
+static void run_division(void* p) {
+    OutputArg* arg = (OutputArg*) p;
+    mpf_div(arg->pi, arg->C, arg->S);
+}
+
+static void setup_output(void* p) {
+    rewind(((OutputArg*) p)->sink);
+}
+
+static void run_output(void* p) {
+    OutputArg* arg = (OutputArg*) p;
+    write_pi_to_stream(arg->pi, arg->digits, arg->sink, 0, arg->format_output, 65536, arg->raw_output,
+        arg->output_format, arg->radix, false, NULL);
+    fflush(arg->sink);
+}
+
+// calculate_M, calculate_X, block_factorial: cost depends on k only
+static void bench_factorials(Bench* bench, const unsigned long* ks, int k_count) {
+    for (int i = 0; i < k_count; i++) {
+        unsigned long k = ks[i];
+        KernelArg arg;
+        kernel_init(bench, &arg, k, k + 1, mpf_get_default_prec());
+        BenchCall M = {run_calculate_M, NULL, &arg};
+        BenchCall X = {run_calculate_X, NULL, &arg};
+
+        #ifdef ENABLE_CACHE
+        miss_cache(&arg);
+        bench_run(bench, "calculate_M", "no_cache", k, 0, &M);
+        bench_run(bench, "calculate_X", "no_cache", k, 0, &X);
+        prime_cache(&arg);
+        bench_run(bench, "calculate_M", "cache", k, 0, &M);
+        bench_run(bench, "calculate_X", "cache", k, 0, &X);
+        #else
+        bench_run(bench, "calculate_M", "no_cache", k, 0, &M);
+        bench_run(bench, "calculate_X", "no_cache", k, 0, &X);
+        #endif
+
+        #ifdef ENABLE_BLOCK_FACTORIAL
+        static const unsigned long block_sizes[] = {1, 4, 16, 64, 256};
+        BenchCall F = {run_block_factorial, setup_block_factorial, &arg};
+        for (size_t b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+            char variant[32];
+            snprintf(variant, sizeof(variant), "block_%lu", block_sizes[b]);
+            arg.block_size = block_sizes[b];
+            bench_run(bench, "block_factorial", variant, k, 0, &F);
+        }
+        #endif
+
+        kernel_clear(&arg);
+    }
+}
+
+// calculate_term at every k that fits in the series for every digit count
+static void bench_terms(Bench* bench, const unsigned long* ks, int k_count, const unsigned long* digits,
+    int digit_count) {
+    for (int d = 0; d < digit_count; d++) {
+        unsigned long iterations = digits[d] / 14 + 1;
+        mp_bitcnt_t prec = (mp_bitcnt_t) ((digits[d] + 2) * log2(10));
+
+        for (int i = 0; i < k_count; i++) {
+            if (ks[i] >= iterations) continue;
+            KernelArg arg;
+            kernel_init(bench, &arg, ks[i], iterations, prec);
+            run_calculate_M(&arg);
+            calculate_L(ks[i], &arg.var);
+            run_calculate_X(&arg);
+
+            BenchCall T = {run_calculate_term, NULL, &arg};
+            bench_run(bench, "calculate_term", "default", ks[i], digits[d], &T);
+            kernel_clear(&arg);
+        }
+    }
+}
+
+// The final pi = C / S and the output writer, formatted, raw, in the binary formats and in hexadecimal
+static void bench_output(Bench* bench, const unsigned long* digits, int digit_count) {
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+
+    for (int d = 0; d < digit_count; d++) {
+        mp_bitcnt_t prec = (mp_bitcnt_t) ((digits[d] + 2) * log2(10));
+        OutputArg arg;
+        arg.digits = digits[d];
+        mpf_init2(arg.pi, prec);
+        mpf_init2(arg.C, prec);
+        mpf_init2(arg.S, prec);
+
+        // Operands of the real sizes: C = 426880 * sqrt(10005), S chosen so that C / S = 3.14...
+        mpf_sqrt_ui(arg.C, 10005);
+        mpf_mul_ui(arg.C, arg.C, 426880);
+        mpf_urandomb(arg.S, state, mpf_get_prec(arg.S));
+        mpf_div_ui(arg.S, arg.S, 100);
+        mpf_add_ui(arg.pi, arg.S, 314);
+        mpf_div_ui(arg.pi, arg.pi, 100);
+        mpf_div(arg.S, arg.C, arg.pi);
+
+        BenchCall div = {run_division, NULL, &arg};
+        bench_run(bench, "mpf_div", "final", 0, digits[d], &div);
+
+        arg.sink = tmpfile();
+        if (!arg.sink) {
+            fprintf(stderr, "Warning: Failed to create a temporary file, skipping write_pi_to_stream\n");
+        } else {
+            BenchCall out = {run_output, setup_output, &arg};
+            arg.format_output = true;
+            arg.raw_output = false;
+            arg.output_format = DIGIT_FORMAT_TEXT;
+            arg.radix = 10;
+            bench_run(bench, "write_pi_to_stream", "formatted", 0, digits[d], &out);
+            arg.format_output = false;
+            arg.raw_output = true;
+            bench_run(bench, "write_pi_to_stream", "raw", 0, digits[d], &out);
+            arg.output_format = DIGIT_FORMAT_PACKED;
+            bench_run(bench, "write_pi_to_stream", "packed", 0, digits[d], &out);
+            arg.output_format = DIGIT_FORMAT_U64;
+            bench_run(bench, "write_pi_to_stream", "u64", 0, digits[d], &out);
+            arg.output_format = DIGIT_FORMAT_TEXT;
+            arg.radix = 16;
+            bench_run(bench, "write_pi_to_stream", "hex", 0, digits[d], &out);
+            fclose(arg.sink);
+        }
+
+        mpf_clears(arg.pi, arg.C, arg.S, NULL);
+    }
+
+    gmp_randclear(state);
+}
+
+void print_usage(const char* program_name) {
+    printf("%s Version %s\n", program_name, PROJECT_VERSION);
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  -o(--output) <filename>           JSON result file, - for stdout (default: pi_bench.json)\n");
+    printf("  --reps <n>                        Timed repetitions per benchmark (default: 5)\n");
+    printf("  --min-time <seconds>              Minimum duration of one repetition (default: 0.01)\n");
+    printf("  --k <k1,k2,...>                   Term indices for the kernel benchmarks (default: 10,100,1000,10000)\n");
+    printf("  --digits <d1,d2,...>              Digit counts for the term, division and output benchmarks (default: 10000,100000,1000000)\n");
+    printf("  -h(--help)                        Display this help message\n");
+}
+
+int main(int argc, char* argv[]) {
+    Bench bench = {5, 0.01, stdout, 0, NULL};
+    const char* output = "pi_bench.json"; // Not stdout: debug builds print from the output writer
+    unsigned long ks[BENCH_MAX_SIZES] = {10, 100, 1000, 10000};
+    unsigned long digits[BENCH_MAX_SIZES] = {10000, 100000, 1000000};
+    int k_count = 4, digit_count = 3;
+
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            bench.reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            bench.min_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--k") == 0 && i + 1 < argc) {
+            k_count = parse_sizes(argv[++i], ks);
+        } else if (strcmp(argv[i], "--digits") == 0 && i + 1 < argc) {
+            digit_count = parse_sizes(argv[++i], digits);
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (bench.reps < 1) {
+        fprintf(stderr, "Warning: invalid repetition count (%d), using 1.\n", bench.reps);
+        bench.reps = 1;
+    }
+
+    if (strcmp(output, "-") != 0) {
+        bench.out = fopen(output, "w");
+        if (!bench.out) {
+            fprintf(stderr, "Error: Failed to open %s\n", output);
+            return 1;
+        }
+    }
+
+    // The build options change the kernels, so they are part of the result
+    fprintf(bench.out, "{\n  \"version\": \"%s\",\n  \"gmp_version\": \"%s\",\n", PROJECT_VERSION, gmp_version);
+    fprintf(bench.out, "  \"options\": {\"cache\": %s, \"block_factorial\": %s, \"precision_taper\": %s},\n",
+        #ifdef ENABLE_CACHE
+        "true",
+        #else
+        "false",
+        #endif
+        #ifdef ENABLE_BLOCK_FACTORIAL
+        "true",
+        #else
+        "false",
+        #endif
+        #ifdef ENABLE_PRECISION_TAPER
+        "true"
+        #else
+        "false"
+        #endif
+    );
+    fprintf(bench.out, "  \"reps\": %d,\n  \"min_time_s\": %g,\n  \"results\": [", bench.reps, bench.min_time);
+
+    PiConstants constants;
+    init_constants(&constants);
+    bench.constants = &constants;
+    bench_factorials(&bench, ks, k_count);
+    bench_terms(&bench, ks, k_count, digits, digit_count);
+    bench_output(&bench, digits, digit_count);
+    clean_constants(&constants);
+
+    fprintf(bench.out, "\n  ]\n}\n");
+    if (bench.out != stdout) fclose(bench.out);
+    return 0;
+}
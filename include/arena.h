@@ -0,0 +1,17 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Route all GMP allocations through per-thread arenas (must be called before any GMP
+// variable is initialized). Returns 0 on success
+int arena_install(void);
+
+// Whether arena_install succeeded
+bool arena_enabled(void);
+
+// Print the peak and total allocated bytes of every thread that used the arena
+void arena_report(FILE* out);
+
+#endif // ARENA_H
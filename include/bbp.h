@@ -0,0 +1,17 @@
+#ifndef BBP_H
+#define BBP_H
+
+#include <gmp.h>
+
+// Hex digits produced per evaluation; the last ones may be off by a carry
+#define BBP_HEX_DIGITS 8
+
+// Hex digits offset+1 .. offset+BBP_HEX_DIGITS after the point of pi by the
+// Bailey-Borwein-Plouffe formula, in O(offset log offset) time and constant memory.
+// hex receives BBP_HEX_DIGITS characters and a terminating zero
+void bbp_hex_digits(unsigned long offset, char* hex);
+
+// The same hex digits of a computed value (fractional part of x * 16^offset)
+void bbp_mpf_hex_digits(const mpf_t x, unsigned long offset, char* hex);
+
+#endif // BBP_H
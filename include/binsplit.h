@@ -0,0 +1,70 @@
+#ifndef BINSPLIT_H
+#define BINSPLIT_H
+
+#include <gmp.h>
+#include <stdbool.h>
+
+// Result of a binary splitting range [a, b)
+typedef struct {
+    mpz_t P, Q, T;
+} BinsplitNode;
+
+// State shared by the binary splitting recursion
+typedef struct {
+    bool show_progress;
+    int progress_freq;
+    unsigned long iterations;       // Total number of terms (for the percentage)
+    unsigned long long completed;   // Number of terms evaluated so far
+    unsigned long leaf_size;        // Ranges up to this many terms are evaluated serially, larger ones as OpenMP tasks
+    unsigned long swap_threshold;   // Ranges of at least this many terms merge out-of-core (0 = in memory)
+    bool quiet;                     // No warnings or errors on stderr (failures are still returned)
+} BinsplitContext;
+
+// Finished adjacent subtrees [0, end[0]), [end[0], end[1]), ..., the rightmost on top
+#define BINSPLIT_STACK_SIZE 64
+typedef struct {
+    BinsplitNode node[BINSPLIT_STACK_SIZE];
+    unsigned long end[BINSPLIT_STACK_SIZE];
+    int count;
+} BinsplitStack;
+
+// Number of tree levels, from the top, that are merged out-of-core when swap is enabled
+#define BINSPLIT_SWAP_LEVELS 3
+
+// Leaf size used when none is given: enough tasks per thread to balance the tree
+unsigned long binsplit_default_leaf_size(unsigned long iterations, int num_threads);
+
+// Initialize / clean up a node
+void binsplit_node_init(BinsplitNode* node);
+void binsplit_node_clear(BinsplitNode* node);
+
+// Compute P(a,b), Q(a,b) and T(a,b) recursively (P is skipped if need_P is false).
+// Inside a parallel region, subtrees larger than ctx->leaf_size are run as OpenMP tasks.
+// Returns 0, or -1 if an out-of-core merge failed (node is then unusable)
+int binsplit_compute(unsigned long a, unsigned long b, BinsplitNode* node, bool need_P,
+    BinsplitContext* ctx);
+
+// Merge the adjacent range right into node (right is clobbered).
+// The products are OpenMP tasks, so call it from inside a parallel region.
+void binsplit_merge(BinsplitNode* node, BinsplitNode* right, bool need_P);
+
+// Evaluate the whole series [0, iterations) and set pi = C * Q / T.
+// Returns 0, or -1 if an out-of-core operand could not be read back
+int binsplit_pi(mpf_t pi, const mpf_t C, unsigned long iterations, BinsplitContext* ctx);
+
+// Initialize an empty stack / clean up the nodes left on it
+void binsplit_stack_init(BinsplitStack* stack);
+void binsplit_stack_clear(BinsplitStack* stack);
+
+// Number of terms covered by the stack
+unsigned long binsplit_stack_end(const BinsplitStack* stack);
+
+// Push the finished subtree [binsplit_stack_end(stack), end) (node is moved into the stack)
+// and merge neighbouring subtrees while the left one is not larger than the right one
+void binsplit_stack_push(BinsplitStack* stack, unsigned long end, BinsplitNode* node);
+
+// Merge everything on the stack (which must cover the whole series) and set pi = C * Q / T.
+// Returns 0, or -1 if an out-of-core operand could not be read back
+int binsplit_stack_pi(mpf_t pi, const mpf_t C, BinsplitStack* stack, BinsplitContext* ctx);
+
+#endif // BINSPLIT_H
@@ -9,8 +9,9 @@
 // Flag Bit Definition
 #define CHECKPOINT_FLAG_CACHE           (1U << 0)   // Enable Caching
 #define CHECKPOINT_FLAG_BLOCK_FACTORIAL (1U << 1)   // Enable block factorial
+#define CHECKPOINT_FLAG_PRECISION_TAPER (1U << 2)   // Enable precision tapering
 
-// Save checkpoint
+// Save checkpoint (written to a temporary file, synced and renamed over filename)
 int save_checkpoint(const char* filename, unsigned long completed_k, const mpf_t global_S,
     unsigned long digits, uint32_t num_threads, uint32_t flags, bool quiet_flag);
 
@@ -18,4 +19,41 @@ int save_checkpoint(const char* filename, unsigned long completed_k, const mpf_t
 int load_checkpoint(const char* filename, unsigned long* completed_k, mpf_t global_S,
     unsigned long req_digits, uint32_t* num_threads, uint32_t* flags, bool quiet_flag);
 
+// Binary splitting checkpoints: the checkpoint file is a manifest listing the ends of the
+// finished subtrees [0, ends[0]), [ends[0], ends[1]), ...; each one has its own node file
+#define CHECKPOINT_MAX_NODES 64
+
+// Save the P, Q and T of the finished subtree [a, b) to its node file
+int save_checkpoint_node(const char* filename, unsigned long a, unsigned long b,
+    const mpz_t P, const mpz_t Q, const mpz_t T, unsigned long digits, bool quiet_flag);
+
+// Load the node file of the subtree [a, b) (0 ok, -1 not found, -2 invalid)
+int load_checkpoint_node(const char* filename, unsigned long a, unsigned long b,
+    mpz_t P, mpz_t Q, mpz_t T, unsigned long req_digits, bool quiet_flag);
+
+// Delete the node file of the subtree [a, b)
+void remove_checkpoint_node(const char* filename, unsigned long a, unsigned long b);
+
+// Save the list of finished subtrees (written like save_checkpoint)
+int save_checkpoint_manifest(const char* filename, const unsigned long* ends, int count,
+    unsigned long digits, uint32_t num_threads, uint32_t flags, bool quiet_flag);
+
+// Load the list of finished subtrees (0 ok, -1 not found, -2 invalid)
+int load_checkpoint_manifest(const char* filename, unsigned long* ends, int* count, int max_count,
+    unsigned long req_digits, uint32_t* num_threads, uint32_t* flags, bool quiet_flag);
+
+// Background checkpoint writer: submissions are snapshotted and written by a dedicated I/O thread
+typedef struct CheckpointWriter CheckpointWriter;
+
+// Start the writer thread for checkpoints of one computation
+CheckpointWriter* checkpoint_writer_create(const char* filename, unsigned long digits, uint32_t num_threads,
+    uint32_t flags, bool quiet_flag, bool verbose);
+
+// Snapshot global_S and queue it; returns without waiting for the disk. A snapshot that has not
+// been picked up yet is replaced by the newer one
+void checkpoint_writer_submit(CheckpointWriter* writer, unsigned long completed_k, const mpf_t global_S);
+
+// Wait for the queued checkpoint to be written and stop the thread
+void checkpoint_writer_destroy(CheckpointWriter* writer);
+
 #endif
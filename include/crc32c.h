@@ -0,0 +1,10 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli) of a buffer; pass the previous result as crc to continue a running checksum (start with 0)
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+#endif // CRC32C_H
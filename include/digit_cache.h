@@ -0,0 +1,51 @@
+#ifndef DIGIT_CACHE_H
+#define DIGIT_CACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Use dir (must exist) as a persistent store of computed digits, holding at most limit bytes.
+// Returns 0 on success
+int digit_cache_init(const char* dir, unsigned long long limit);
+
+// Whether digit_cache_init succeeded
+bool digit_cache_enabled(void);
+
+// A stored result opened for reading its decimals
+typedef struct DigitCacheEntry DigitCacheEntry;
+
+// Open the smallest stored result with at least digits decimals whose first digits decimals
+// pass their checksums, and mark it as recently used. NULL if there is none
+DigitCacheEntry* digit_cache_open(unsigned long digits);
+
+// Number of decimals stored in the entry
+unsigned long digit_cache_entry_digits(const DigitCacheEntry* entry);
+
+// Read up to len decimals from the current position of entry (a DigitCacheEntry*).
+// Returns the number read, 0 at the end or on error
+size_t digit_cache_read(char* buffer, size_t len, void* entry);
+
+// Go back to the first decimal
+int digit_cache_rewind(DigitCacheEntry* entry);
+
+void digit_cache_close(DigitCacheEntry* entry);
+
+// Start storing a result of digits decimals; the output writer appends them as it writes.
+// Returns 0 on success
+int digit_cache_begin(unsigned long digits);
+
+// Whether a result is being stored
+bool digit_cache_recording(void);
+
+// Append decimals to the result being stored
+void digit_cache_append(const char* digits, size_t len);
+
+// Finish the stored result if all of its decimals were appended (dropping it otherwise) and
+// evict the least recently used results over the limit. Returns 0 if it was stored
+int digit_cache_commit(void);
+
+// Drop the result being stored (its output failed)
+void digit_cache_discard(void);
+
+#endif // DIGIT_CACHE_H
@@ -0,0 +1,48 @@
+#ifndef DIGIT_FORMAT_H
+#define DIGIT_FORMAT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Encoding of the output digits
+typedef enum {
+    DIGIT_FORMAT_TEXT = 0,      // ASCII, raw or formatted (with the text header)
+    DIGIT_FORMAT_PACKED,        // Two digits per byte, first digit in the high nibble
+    DIGIT_FORMAT_U64            // 19 digits per little-endian 64-bit word
+} DigitFormat;
+
+// Binary files: "PIDF", version (u8), format (u8), 2 reserved, digits (u64),
+// computation time (IEEE double as u64), then the encoded decimals after "3."
+// (the last byte or word padded with zero digits)
+#define DIGIT_FORMAT_HEADER_SIZE 24
+#define DIGIT_FORMAT_U64_DIGITS 19
+
+// Parse "text", "packed" or "u64". Returns 0 on success
+int digit_format_parse(const char* name, DigitFormat* format);
+
+// Digits and bytes of one encoded group (2 and 1 for packed, 19 and 8 for u64)
+size_t digit_format_group_digits(DigitFormat format);
+size_t digit_format_group_bytes(DigitFormat format);
+
+// Fill the header of a binary file
+void digit_format_header(unsigned char* header, DigitFormat format, unsigned long digits, double computation_time);
+
+// Encode count groups (2 digits for packed, 19 for u64) of ASCII digits into out; returns the bytes written
+size_t digit_format_encode(DigitFormat format, const char* digits, size_t count, unsigned char* out);
+
+// Decode count groups into ASCII digits; returns the digits written
+size_t digit_format_decode(DigitFormat format, const unsigned char* in, size_t count, char* out);
+
+// Reads the decimals of a binary file back as ASCII
+typedef struct DigitDecoder DigitDecoder;
+
+// Read the header of a binary file. Returns NULL if it is not one (or on allocation failure)
+DigitDecoder* digit_decoder_open(FILE* fp, unsigned long* digits, double* computation_time);
+
+// DigitSource reading the next len decimals (arg: a DigitDecoder*). Returns the number read, 0 on error
+size_t digit_decoder_read(char* buffer, size_t len, void* arg);
+
+void digit_decoder_close(DigitDecoder* decoder);
+
+#endif // DIGIT_FORMAT_H
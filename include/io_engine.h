@@ -0,0 +1,44 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Backend writing the result file
+typedef enum {
+    IO_ENGINE_STDIO = 0,    // fopen/fwrite (default; always used for pipes and --stdout)
+    IO_ENGINE_DIRECT,       // O_DIRECT from aligned buffers, written by a background thread
+    IO_ENGINE_URING         // O_DIRECT from aligned buffers, queued to io_uring (Linux)
+} IoEngine;
+
+// Parse "stdio", "direct" or "uring". Returns 0 on success
+int io_engine_parse(const char* name, IoEngine* engine);
+
+// Write result files with engine from now on. Returns 0, or -1 if it is not available on this
+// system (stdio stays selected)
+int io_engine_select(IoEngine engine);
+
+// Whether an engine other than stdio is selected
+bool io_engine_enabled(void);
+
+// A result file being written by the selected engine
+typedef struct IoWriter IoWriter;
+
+// Create filename for the selected engine with a ring of aligned buffers of about buffer_size
+// bytes. Returns NULL if stdio is selected, filename is not a regular file (a pipe, a device)
+// or it cannot be opened; the caller then writes through stdio
+IoWriter* io_writer_open(const char* filename, size_t buffer_size);
+
+// Copy len bytes into the current buffer and queue every full buffer for writing. Only waits
+// when all buffers are still being written
+void io_writer_write(IoWriter* writer, const void* data, size_t len);
+
+// Queue the last buffer, wait for every write and close the file. Returns 0, or -1 if a write
+// failed (errno is set)
+int io_writer_close(IoWriter* writer);
+
+// Print the engine, the bytes written and the achieved throughput of the files written so far
+void io_engine_report(FILE* out);
+
+#endif // IO_ENGINE_H
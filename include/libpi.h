@@ -0,0 +1,68 @@
+#ifndef LIBPI_H
+#define LIBPI_H
+
+// libpi: compute pi with the Chudnovsky series inside another program.
+//
+// A PiContext holds the settings and the series constants of a computation, so repeated
+// requests reuse them. Contexts are independent: several threads may each compute with
+// their own context at the same time. One context must not be used by two threads at once.
+// No function prints, exits or changes process-wide GMP state; failures are returned as a
+// PiStatus. The shared library exports only the functions declared here.
+
+#include <gmp.h>
+#include <stdbool.h>
+
+// Functions exported from the shared library (everything else is built with hidden visibility)
+#if defined(_WIN32) && defined(PI_BUILDING_LIBRARY)
+#define PI_API __declspec(dllexport)
+#elif defined(__GNUC__) && !defined(_WIN32)
+#define PI_API __attribute__((visibility("default")))
+#else
+#define PI_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Result of a libpi call
+typedef enum {
+    PI_OK = 0,
+    PI_ERROR_INVALID_ARGUMENT,  // Unknown algorithm or schedule, zero digits, ...
+    PI_ERROR_OUT_OF_MEMORY,
+    PI_ERROR_CONVERSION,        // The decimal conversion failed
+    PI_ERROR_IO                 // Out-of-core operands could not be read back from the swap directory
+} PiStatus;
+
+typedef struct PiContext PiContext;
+
+// Create a context computing with num_threads OpenMP threads (0: the OpenMP default).
+// Returns NULL if it cannot be allocated
+PI_API PiContext* pi_context_create(int num_threads);
+
+// Release a context and its constants
+PI_API void pi_context_destroy(PiContext* ctx);
+
+// Series evaluation algorithm: "series" (default) or "binsplit"
+PI_API PiStatus pi_context_set_algorithm(PiContext* ctx, const char* algorithm);
+
+// Loop schedule of the series algorithm: "static", "dynamic", "guided" (default) or "contiguous"
+PI_API PiStatus pi_context_set_schedule(PiContext* ctx, const char* schedule, int chunk_size);
+
+// Compute pi to digits decimal digits into pi (initialized by the caller; its precision is set here)
+PI_API PiStatus pi_compute(PiContext* ctx, unsigned long digits, mpf_t pi);
+
+// Compute pi and return it as "3." followed by digits decimals in *str; free it with pi_free_string
+PI_API PiStatus pi_compute_string(PiContext* ctx, unsigned long digits, char** str);
+
+// Free a string returned by pi_compute_string
+PI_API void pi_free_string(char* str);
+
+// Human-readable description of a status
+PI_API const char* pi_status_string(PiStatus status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBPI_H
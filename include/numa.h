@@ -0,0 +1,34 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Read the NUMA topology (Linux sysfs) and spread num_threads workers over the nodes:
+// consecutive thread IDs share a node, in proportion to the node's usable CPUs.
+// Returns 0 on success, -1 if the topology is not available
+int numa_setup(int num_threads);
+
+// Whether numa_setup succeeded
+bool numa_enabled(void);
+
+// Pin the calling thread to the CPU of worker tid
+void numa_bind_thread(int tid);
+
+// Node of worker tid, and the workers [numa_node_first(n), numa_node_first(n + 1)) of node n
+int numa_thread_node(int tid);
+int numa_node_first(int node);
+int numa_node_count(void);
+
+// Largest number of workers on one node
+int numa_max_node_threads(void);
+
+// Timing of the phases, per worker and per node
+void numa_add_compute_time(int tid, double seconds);
+void numa_add_reduction_time(int node, double seconds);
+void numa_add_cross_node_time(double seconds);
+
+// Print the threads, compute and reduction time of every node
+void numa_report(FILE* out);
+
+#endif // NUMA_H
@@ -0,0 +1,32 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Phases the hardware counters are attributed to
+typedef enum {
+    PERF_CALCULATE_M,
+    PERF_CALCULATE_X,
+    PERF_ADVANCE_M_X,       // Contiguous schedule: M and X from their predecessors
+    PERF_CALCULATE_TERM,
+    PERF_REDUCTION,
+    PERF_OUTPUT,            // Conversion and writing, on the calling thread
+    PERF_PHASES
+} PerfPhase;
+
+// Count cycles, instructions, LLC misses and page faults per thread and phase (Linux
+// perf_event_open). Returns 0 if at least one counter can be opened, -1 otherwise
+int perf_enable(void);
+
+// Whether perf_enable succeeded
+bool perf_enabled(void);
+
+// Start / stop counting a phase on the calling thread (its counters are opened on first use)
+void perf_phase_begin(void);
+void perf_phase_end(PerfPhase phase);
+
+// Print the counters of every phase, in total and per thread
+void perf_report(FILE* out);
+
+#endif // PERF_H
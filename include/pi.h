@@ -1,6 +1,8 @@
 #ifndef PI_H
 #define PI_H
 
+#include "libpi.h"
+#include "digit_format.h"
 #include <gmp.h>
 #include <math.h>
 #include <time.h>
@@ -13,17 +15,40 @@
 #define VAR_BLOCK_SIZE
 #endif
 
-// Calculate PI to the specified number of digits
-void calculate_pi(mpf_t pi, unsigned long digits, int num_threads, const char *omp_schedule,
-    int chunk_size VAR_BLOCK_SIZE, bool show_progress, int progress_freq, bool quiet_flag,
-    bool enable_checkpoint, unsigned long checkpoint_freq, const char *checkpoint_file, bool checkpoint_verbose);
+// Calculate PI to the specified number of digits (algorithm: "series" or "binsplit").
+// Returns PI_OK, PI_ERROR_OUT_OF_MEMORY if the worker state cannot be allocated, or PI_ERROR_IO if
+// binsplit operands spilled to the swap directory cannot be read back
+PiStatus calculate_pi(mpf_t pi, unsigned long digits, const char *algorithm, int num_threads, const char *omp_schedule,
+    int chunk_size VAR_BLOCK_SIZE, unsigned long leaf_size, bool show_progress, int progress_freq, bool quiet_flag,
+    bool enable_checkpoint, unsigned long checkpoint_freq, const char *checkpoint_file, bool checkpoint_verbose,
+    double* reduction_time);
 
-// Write the PI value to file
-void write_pi_to_file(const mpf_t pi, unsigned long digits, const char* filename, double computation_time,
-    bool format_output, size_t buffer_size, bool raw_output);
+// Write the PI value to file (conversion_time, if not NULL, receives the decimal conversion time).
+// Returns 0 on success, -1 if the digits could not be converted or written completely.
+// With stream_output the digits are converted and written in buffer_size chunks instead of as one string.
+// A binary output_format writes its header and the encoded decimals instead of text (format_output
+// and raw_output are then ignored). With radix 2 or 16, digits counts digits of that radix, which are
+// read straight from the limbs (always in chunks) with the same header and layout; output_format must
+// then be DIGIT_FORMAT_TEXT.
+int write_pi_to_file(const mpf_t pi, unsigned long digits, const char* filename, double computation_time,
+    bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format, int radix,
+    bool stream_output, double* conversion_time);
 
-// Write the PI value to stream
-void write_pi_to_stream(const mpf_t pi, unsigned long digits, FILE* stream, double computation_time,
-    bool format_output, size_t buffer_size, bool raw_output);
+// Write the PI value to stream (see write_pi_to_file)
+int write_pi_to_stream(const mpf_t pi, unsigned long digits, FILE* stream, double computation_time,
+    bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format, int radix,
+    bool stream_output, double* conversion_time);
+
+// Source of already computed decimals: reads up to len of them into buffer and returns how many (0 on error)
+typedef size_t (*DigitSource)(char* buffer, size_t len, void* arg);
+
+// Write the first digits decimals of source with the same header and layout as write_pi_to_file,
+// without any computation. Returns 0 on success
+int write_pi_digits_to_file(DigitSource source, void* arg, unsigned long digits, const char* filename,
+    double computation_time, bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format);
+
+// Write the first digits decimals of source to stream (see write_pi_digits_to_file)
+int write_pi_digits_to_stream(DigitSource source, void* arg, unsigned long digits, FILE* stream,
+    double computation_time, bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format);
 
 #endif // PI_H
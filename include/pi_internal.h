@@ -0,0 +1,120 @@
+#ifndef PI_INTERNAL_H
+#define PI_INTERNAL_H
+
+// Kernels of the series algorithm, shared by pi.c, libpi and the pi_bench microbenchmarks.
+// Not part of the pi_calculator interface: the layout follows the build options.
+
+#include "pi.h"
+#include <gmp.h>
+
+#ifdef ENABLE_PRECISION_TAPER
+#define PRECISION_TAPER_BANDS 16    // Per-thread partial sums, one per precision band
+#define PRECISION_GUARD_BITS  64    // Extra bits kept on every term
+#define TERM_BITS_PER_K       47.11 // log2(640320^3 / 1728): each term is this many bits smaller than the last
+#endif
+
+// Constants of the series, shared read-only by the workers of one computation
+typedef struct {
+    mpz_t x_base;   // -262537412640768000
+    mpz_t l_k;      // 545140134
+    mpz_t l_add;    // 13591409
+} PiConstants;
+
+// Type definition for thread private variables
+typedef struct {
+    const PiConstants* constants;
+    mpf_t S, term, temp_f;
+    mpz_t temp, M, L, X, K, k_fact, three_k_fact, six_k_fact;
+    #ifdef ENABLE_BLOCK_FACTORIAL
+    // Block factorial variables
+    mpz_t block_prod; // Block product for block factorial
+    unsigned long block_size; // Block size for block factorial
+    #endif
+    #ifdef ENABLE_PRECISION_TAPER
+    // Precision tapering variables
+    mpf_t band_S[PRECISION_TAPER_BANDS]; // Partial sums by precision band
+    mp_bitcnt_t full_prec;               // Precision of the whole sum
+    unsigned long band_terms;            // Number of terms per band
+    #endif
+    #ifdef DEBUG
+    unsigned long cache_hits;            // Terms that reused the previous factorials or power
+    #endif
+} ThreadVariables;
+
+#ifdef ENABLE_CACHE
+// Cache for factorials and powers
+typedef struct {
+    unsigned long k_M, K_X;
+    mpz_t k_fact, three_k_fact, six_k_fact, X;
+} ThreadCache;
+#endif
+
+
+// Initialize / clean up the constants used by calculate_L and calculate_X
+void init_constants(PiConstants* constants);
+void clean_constants(PiConstants* constants);
+
+// Initialize thread variables with floats of prec bits and integers sized for the terms up to
+// max_k so they never grow; constants must outlive them
+void init_thread_variables(ThreadVariables* var, unsigned long max_k, mp_bitcnt_t prec,
+    const PiConstants* constants);
+void clean_thread_variables(ThreadVariables* var);
+
+// Start a new block: the sums go back to zero, everything else is kept
+void reset_thread_sums(ThreadVariables* var);
+
+#ifdef ENABLE_PRECISION_TAPER
+// Initialize the band sums for a series of iterations terms (also records the full precision)
+void init_precision_bands(ThreadVariables* var, unsigned long iterations);
+
+// Add the term k to the sum of its band
+void accumulate_term(unsigned long k, ThreadVariables* var);
+
+// Add the band sums to S and give term and temp_f back their full precision
+void merge_precision_bands(ThreadVariables* var);
+#endif
+
+#ifdef ENABLE_CACHE
+// Initialize thread cache, sized for the terms up to max_k
+void init_thread_cache(ThreadCache* cache, unsigned long max_k);
+void clean_thread_cache(ThreadCache* cache);
+
+// Remember the factorials and power of term k
+void set_cache(unsigned long k, ThreadCache* cache, ThreadVariables* var);
+#endif
+
+#ifdef ENABLE_BLOCK_FACTORIAL
+// fact *= start * (start + 1) * ... * end, multiplied in blocks of block_size factors
+void block_factorial(unsigned long start, unsigned long end, unsigned long block_size, mpz_t block_prod, mpz_t fact);
+#endif
+
+// Calculate M = (6k)! / ((3k)! * (k!)^3), from the cached factorials of k - 1 when possible
+#ifdef ENABLE_CACHE
+void calculate_M(unsigned long k, ThreadVariables* var, ThreadCache* cache);
+#else
+void calculate_M(unsigned long k, ThreadVariables* var);
+#endif
+
+// Advance M and X from k-1 to k by their exact ratios (contiguous schedule)
+void advance_M_X(unsigned long k, ThreadVariables* var);
+
+// Calculate L = 545140134k + 13591409
+void calculate_L(unsigned long k, ThreadVariables* var);
+
+// Calculate X = (-262537412640768000)^k, from the cached power of k - 1 when possible
+#ifdef ENABLE_CACHE
+void calculate_X(unsigned long k, ThreadVariables* var, ThreadCache* cache);
+#else
+void calculate_X(unsigned long k, ThreadVariables* var);
+#endif
+
+// Calculate the current item: term = M * L / X
+void calculate_term(unsigned long k, ThreadVariables* var);
+
+// calculate_pi with caller-owned constants (kept across computations by a libpi context)
+PiStatus calculate_pi_constants(const PiConstants* constants, mpf_t pi, unsigned long digits, const char *algorithm,
+    int num_threads, const char *omp_schedule, int chunk_size VAR_BLOCK_SIZE, unsigned long leaf_size,
+    bool show_progress, int progress_freq, bool quiet_flag, bool enable_checkpoint, unsigned long checkpoint_freq,
+    const char *checkpoint_file, bool checkpoint_verbose, double* reduction_time);
+
+#endif // PI_INTERNAL_H
@@ -0,0 +1,32 @@
+#ifndef RADIX_H
+#define RADIX_H
+
+#include <gmp.h>
+#include <stddef.h>
+
+// Convert a positive x to its first n_digits significant decimal digits.
+// Works like mpf_get_str(NULL, exp, 10, n_digits, x), but splits the number
+// recursively by 10^(2^i) and converts the halves in parallel (OpenMP tasks).
+// The returned string is always n_digits long and must be released with free().
+char* radix_get_str(mp_exp_t* exp, size_t n_digits, const mpf_t x);
+
+// Receives consecutive pieces of the decimal digits, in order
+typedef void (*radix_sink_fn)(const char* digits, size_t len, void* arg);
+
+// N = round(x * 10^(n_digits - exp)), the n_digits significant digits of a positive x as an integer
+void radix_scale_digits(mpz_t N, mp_exp_t* exp, size_t n_digits, const mpf_t x);
+
+// Stream the n_digits digits of N to sink in pieces of at most chunk_digits digits
+// (but at least one 4096-digit leaf). Only one piece exists as text at a time; N is cleared.
+// Returns 0, or -1 if the conversion buffers cannot be allocated (nothing is sent to sink)
+int radix_stream(mpz_t N, size_t n_digits, size_t chunk_digits, radix_sink_fn sink, void* arg);
+
+// Decimal digits to compute so that the first n_digits digits in radix (2, 10 or 16) are covered
+size_t radix_decimal_digits(size_t n_digits, int radix);
+
+// Stream the first n_digits fractional digits of a positive x in radix 2 or 16 to sink, in pieces
+// of at most chunk_digits digits. The digits are read straight off the limbs, in linear time.
+// Returns 0, or -1 if the chunk buffer cannot be allocated (nothing is sent to sink)
+int radix_stream_pow2(const mpf_t x, int radix, size_t n_digits, size_t chunk_digits, radix_sink_fn sink, void* arg);
+
+#endif // RADIX_H
@@ -0,0 +1,45 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Phases of a run, in the order they happen
+typedef enum {
+    STATS_SETUP,            // Constants, sqrt(10005) and worker state
+    STATS_CHECKPOINT_LOAD,  // Checkpoint recovery
+    STATS_SERIES,           // Term evaluation (binsplit: tree evaluation and merges)
+    STATS_REDUCTION,        // Merging the per-thread sums
+    STATS_CHECKPOINT_SAVE,  // Checkpoint saves on the critical path
+    STATS_DIVISION,         // pi = C / S
+    STATS_CONVERSION,       // Radix conversion to decimal
+    STATS_WRITE,            // Formatting and writing the digits
+    STATS_PHASES
+} StatsPhase;
+
+// Collect per-phase statistics for a run with num_threads threads. Returns 0 on success
+int stats_enable(int num_threads);
+
+// Whether stats_enable succeeded
+bool stats_enabled(void);
+
+// Parameters of the run, copied into the report
+void stats_set_run(unsigned long digits, const char* algorithm, const char* schedule, int chunk_size);
+
+// Add wall time to a phase
+void stats_add_time(StatsPhase phase, double seconds);
+
+// One series block [start_k, end_k): its evaluation and reduction wall times
+void stats_add_block(unsigned long start_k, unsigned long end_k, double series, double reduction);
+
+// Time worker tid spent evaluating terms in a block, time it waited for the slowest worker,
+// and the number of terms it evaluated
+void stats_add_thread(int tid, double busy, double idle, unsigned long terms);
+
+// Bytes of output written
+void stats_add_output(unsigned long long bytes);
+
+// Write the report as JSON (total_time: the whole run). Returns 0 on success
+int stats_write_json(const char* filename, double total_time);
+
+#endif // STATS_H
@@ -0,0 +1,37 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include <stdio.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// A big integer spilled to a file in the swap directory
+typedef struct {
+    char* path;
+    int sign;           // -1, 0 or 1
+    size_t limbs;       // Number of limbs of |x|
+} SwapInt;
+
+// Enable out-of-core storage in the given directory (must exist). Returns 0 on success
+int swap_init(const char* dir);
+
+// Whether swap_init succeeded
+bool swap_enabled(void);
+
+// Write x to disk in large sequential blocks and release its memory. Returns 0 on success
+int swap_out(SwapInt* s, mpz_t x);
+
+// Read a spilled integer back into x (the file is kept). Returns 0 on success
+int swap_in(mpz_t x, const SwapInt* s);
+
+// rop = a * b, streaming a from disk one block at a time (rop must not be b). Returns 0 on success
+int swap_mul(mpz_t rop, const SwapInt* a, const mpz_t b);
+
+// Delete the file behind a spilled integer
+void swap_release(SwapInt* s);
+
+// Print the bytes moved to and from disk and the peak resident memory of the process
+void swap_report(FILE* out);
+
+#endif // SWAP_H
@@ -0,0 +1,30 @@
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The formatted layout puts a space between blocks of 10 digits and a newline between lines of
+// 100, so every line takes 110 bytes and the position of any digit in the file is known in advance.
+
+// Bytes taken by the first index digits of the formatted layout (separators included)
+uint64_t text_layout_offset(uint64_t index);
+
+// Offset at which the digits of the layout start if they are written to stream with
+// text_layout_pwrite: the current position of a regular file. Returns -1 for pipes,
+// terminals and platforms without pwrite (the caller then writes through stdio)
+int64_t text_layout_begin(FILE* stream);
+
+// Format the digits first .. first + len - 1 of the layout and pwrite them to stream at
+// base + text_layout_offset(first). The range is split at line boundaries across the OpenMP
+// threads, each formatting buffer_size bytes at a time into its own buffer. Returns the
+// bytes written, or -1 on a write error (errno is set)
+int64_t text_layout_pwrite(FILE* stream, int64_t base, const char* digits, size_t len, uint64_t first,
+    size_t buffer_size);
+
+// Move the position of stream to the end of the first digits digits of the layout.
+// Returns 0, or -1 if the stream cannot be positioned (errno is set)
+int text_layout_end(FILE* stream, int64_t base, uint64_t digits);
+
+#endif // TEXT_LAYOUT_H
@@ -0,0 +1,19 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+// Record spans for a Chrome / Perfetto trace (timestamps relative to this call). Returns 0 on success
+int trace_enable(void);
+
+// Whether trace_enable succeeded; callers take no timestamps otherwise
+bool trace_enabled(void);
+
+// Record a span [start, end] (omp_get_wtime seconds) on the calling thread. name must be a
+// string literal; the k range [k_begin, k_end) is added to the event when k_end > k_begin
+void trace_span(const char* name, double start, double end, unsigned long k_begin, unsigned long k_end);
+
+// Write all spans in trace-event format. Call when no other thread is recording. Returns 0 on success
+int trace_write(const char* filename);
+
+#endif // TRACE_H
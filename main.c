@@ -1,5 +1,15 @@
 #include "pi.h"
 #include "pi_ref.h"
+#include "swap.h"
+#include "arena.h"
+#include "numa.h"
+#include "stats.h"
+#include "perf.h"
+#include "trace.h"
+#include "digit_cache.h"
+#include "bbp.h"
+#include "radix.h"
+#include "io_engine.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,23 +20,40 @@ void print_usage(const char* program_name) {
     printf("%s Version %s\n", program_name, PROJECT_VERSION);
     printf("Usage: %s [options]\n", program_name);
     printf("Options:\n");
-    printf("  -d(--digits) <digits>             Number of digits to calculate (default: 1000)\n");
+    printf("  -d(--digits) <digits>             Number of digits to calculate, in the output radix (default: 1000)\n");
     printf("  -o(--output) <filename>           Output file name (default: pi.txt)\n");
     printf("  -t(--thread) <threads>            Number of threads to use (default: number of CPU cores)\n");
     printf("  -f(--format)                      Format output (default: unformatted)\n");
     printf("  --disable-output                  Disable output file\n");
+    printf("  --algorithm <name>                Series evaluation algorithm (series, binsplit) (default: series)\n");
+    printf("  --leaf-size <terms>               Terms per serial binsplit subtree; larger ones run as parallel tasks (default: auto)\n");
+    printf("  --swap-dir <dir>                  Keep the largest binsplit operands in <dir> while merging (out-of-core)\n");
+    printf("  --allocator <name>                GMP memory allocator (malloc, arena) (default: malloc)\n");
+    printf("  --numa                            Pin series workers per NUMA node, allocate on the local node, reduce per node\n");
+    printf("  --stats <filename>                Write per-phase timing, load balance and throughput as JSON\n");
+    printf("  --perf-counters                   Count cycles, instructions, LLC misses and page faults per thread and phase (Linux)\n");
+    printf("  --trace <filename>                Write a per-thread timeline in Chrome/Perfetto trace-event format\n");
+    printf("  --cache-dir <dir>                 Serve requests from results stored in <dir>; store written results there\n");
+    printf("  --cache-limit <MB>                Size of --cache-dir; least recently used results are deleted (default: 4096)\n");
     printf("  --buffer-size <size>              Set buffer size in bytes (default: 65536)\n");
-    printf("  --schedule <schedule>             Set OpenMP schedule type (static, dynamic, guided) and chunk size (default: guided)\n");
+    printf("  --schedule <schedule>             Set OpenMP schedule type (static, dynamic, guided, contiguous) and chunk size (default: guided)\n");
     #ifdef ENABLE_BLOCK_FACTORIAL
     printf("  --block-size <size>               Set block size for factorial calculation (default: 8)\n");
     #endif
+    printf("  --io-engine <engine>              Result file backend: stdio, direct (O_DIRECT + writer thread), uring (io_uring) (default: stdio)\n");
+    printf("  --stream-output                   Convert and write the digits in buffer-size chunks (no full digit string in memory)\n");
     printf("  --raw                             Output raw digits only (no header, no \"3.\" line, no formatting)\n");
+    printf("  --output-format <format>          Output encoding: text, packed (2 digits/byte), u64 (19 digits/word) (default: text)\n");
+    printf("  --radix <radix>                   Output radix: 10, 16 or 2, read straight from the binary result (default: 10)\n");
+    printf("  --decode <filename>               Convert a packed or u64 file to the output format (text by default) and exit\n");
     printf("  --quiet                           Suppress all informational output (errors still go to stderr)\n");
     printf("  --stdout                          Write result to standard output instead of a file (overrides -o)\n");
     printf("  --progress                        Show progress during long calculations (disabled by --quiet)\n");
     printf("  --progress-freq <num>             Update progress every <num> iterations (default: 1000, only with --progress)\n");
     printf("  --time-file <filename>            Write computation time to a separate file (even with --quiet)\n");
     printf("  --verify                          Verify first 1000 digits of result against known value (exit code 2 if mismatch)\n");
+    printf("  --bbp-check                       Check hex digits near the end of the result with the BBP formula (exit code 2 if mismatch)\n");
+    printf("  --bbp-hex <offset>                Only print the hex digits of pi after position <offset> (BBP formula) and exit\n");
     printf("  --checkpoint-enable               Enable checkpoint/restart functionality\n");
     printf("  --checkpoint-freq <N>             Save checkpoint every N iterations (default: 1000)\n");
     printf("  --checkpoint-file <filename>      Path to checkpoint file (default: pi_checkpoint.dat)\n");
@@ -35,22 +62,47 @@ void print_usage(const char* program_name) {
     printf("  -h(--help)                        Show this help message\n");
 }
 
+// Release a string allocated by GMP with GMP's own free function (it may not be malloc's)
+static void free_gmp_str(char* str) {
+    void (*gmp_free)(void*, size_t);
+    mp_get_memory_functions(NULL, NULL, &gmp_free);
+    gmp_free(str, strlen(str) + 1);
+}
+
 int main(int argc, char* argv[]) {
     unsigned long digits = 1000;
     char* output_file = "pi.txt";
     int num_threads = omp_get_max_threads();
+    char* algorithm = "series";                     // Default series evaluation algorithm
+    unsigned long leaf_size = 0;                    // Binsplit task cutoff (0 = automatic)
+    char* swap_dir = NULL;                          // Out-of-core directory for --swap-dir
+    char* allocator = "malloc";                     // GMP memory allocator
+    bool numa_flag = false;                         // flag for --numa
+    char* stats_file = NULL;                        // JSON report for --stats
+    bool perf_flag = false;                         // flag for --perf-counters
+    char* trace_file = NULL;                        // Timeline for --trace
+    char* cache_dir = NULL;                         // Digit store for --cache-dir
+    unsigned long long cache_limit = 4096ULL << 20; // Size of the digit store in bytes
     bool enable_output = true;                      // Default to enabled output
     bool format_output = false;                     // Default to unformatted output
     size_t buffer_size = 65536;                     // Default buffer size
     char* omp_schedule = "guided";                  // Default OpenMP schedule type
     int chunk_size = 1;                             // Default chunk size
     bool raw_output = false;                        // flag for --raw
+    DigitFormat output_format = DIGIT_FORMAT_TEXT;  // Encoding for --output-format
+    char* decode_file = NULL;                       // Binary input for --decode
+    int radix = 10;                                 // Output radix for --radix
+    bool stream_output = false;                     // flag for --stream-output
+    IoEngine io_engine = IO_ENGINE_STDIO;           // Backend for --io-engine
     bool quiet_flag = false;                        // flag for --quiet
     bool stdout_flag = false;                       // flag for --stdout
     bool progress_flag = false;                     // flag for --progress
     int progress_freq = 1000;                       // default frequency for progress updates
     char* time_file = NULL;                         // flag for --time-file
     bool verify_flag = false;                       // flag for --verify
+    bool bbp_check = false;                         // flag for --bbp-check
+    bool bbp_hex = false;                           // flag for --bbp-hex
+    unsigned long bbp_offset = 0;                   // Hex position for --bbp-hex
     #ifdef ENABLE_BLOCK_FACTORIAL
     unsigned long block_size = 8;                   // Default block size for factorial
     #endif
@@ -71,6 +123,39 @@ int main(int argc, char* argv[]) {
             format_output = true;
         } else if (strcmp(argv[i], "--disable-output") == 0) {
             enable_output = false;
+        } else if (strcmp(argv[i], "--algorithm") == 0 && i + 1 < argc) {
+            algorithm = argv[++i];
+            if (strcmp(algorithm, "series") != 0 && strcmp(algorithm, "binsplit") != 0) {
+                fprintf(stderr, "Invalid algorithm: %s\n", algorithm);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--leaf-size") == 0 && i + 1 < argc) {
+            leaf_size = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--swap-dir") == 0 && i + 1 < argc) {
+            swap_dir = argv[++i];
+        } else if (strcmp(argv[i], "--allocator") == 0 && i + 1 < argc) {
+            allocator = argv[++i];
+            if (strcmp(allocator, "malloc") != 0 && strcmp(allocator, "arena") != 0) {
+                fprintf(stderr, "Invalid allocator: %s\n", allocator);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            numa_flag = true;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_file = argv[++i];
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            perf_flag = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-limit") == 0 && i + 1 < argc) {
+            unsigned long long limit = strtoull(argv[++i], NULL, 10);
+            if (limit == 0) {
+                fprintf(stderr, "Error: cache limit must be positive.\n");
+                return 1;
+            }
+            cache_limit = limit << 20;
         } else if (strcmp(argv[i], "--buffer-size") == 0 && i + 1 < argc) {
             buffer_size = strtoul(argv[++i], NULL, 10);
             if (buffer_size < 1024) {
@@ -95,7 +180,8 @@ int main(int argc, char* argv[]) {
 
             if (strcmp(omp_schedule, "static") != 0 &&
                 strcmp(omp_schedule, "dynamic") != 0 &&
-                strcmp(omp_schedule, "guided") != 0) {
+                strcmp(omp_schedule, "guided") != 0 &&
+                strcmp(omp_schedule, "contiguous") != 0) {
                 fprintf(stderr, "Invalid OpenMP schedule type: %s\n", omp_schedule);
                 return 1;
             }
@@ -107,8 +193,28 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
         #endif
+        } else if (strcmp(argv[i], "--io-engine") == 0 && i + 1 < argc) {
+            if (io_engine_parse(argv[++i], &io_engine) != 0) {
+                fprintf(stderr, "Invalid I/O engine: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stream-output") == 0) {
+            stream_output = true;
         } else if (strcmp(argv[i], "--raw") == 0) {
             raw_output = true;
+        } else if (strcmp(argv[i], "--output-format") == 0 && i + 1 < argc) {
+            if (digit_format_parse(argv[++i], &output_format) != 0) {
+                fprintf(stderr, "Invalid output format: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--radix") == 0 && i + 1 < argc) {
+            radix = atoi(argv[++i]);
+            if (radix != 10 && radix != 16 && radix != 2) {
+                fprintf(stderr, "Invalid radix: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--decode") == 0 && i + 1 < argc) {
+            decode_file = argv[++i];
         } else if (strcmp(argv[i], "--quiet") == 0) {
             quiet_flag = true;
         } else if (strcmp(argv[i], "--stdout") == 0) {
@@ -126,6 +232,11 @@ int main(int argc, char* argv[]) {
             time_file = argv[++i];
         } else if (strcmp(argv[i], "--verify") == 0) {
             verify_flag = true;
+        } else if (strcmp(argv[i], "--bbp-check") == 0) {
+            bbp_check = true;
+        } else if (strcmp(argv[i], "--bbp-hex") == 0 && i + 1 < argc) {
+            bbp_hex = true;
+            bbp_offset = strtoul(argv[++i], NULL, 10);
         } else if (strcmp(argv[i], "--checkpoint-enable") == 0) {
             checkpoint_enable = true;
         } else if (strcmp(argv[i], "--checkpoint-freq") == 0 && i + 1 < argc) {
@@ -151,6 +262,72 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // Digit extraction at one position, without computing the digits before it
+    if (bbp_hex) {
+        omp_set_num_threads(num_threads);
+        double bbp_start = omp_get_wtime();
+        char hex[BBP_HEX_DIGITS + 1];
+        bbp_hex_digits(bbp_offset, hex);
+        if (quiet_flag) {
+            printf("%s\n", hex);
+        } else {
+            printf("Hex digits %lu to %lu of pi: %s\n", bbp_offset + 1, bbp_offset + BBP_HEX_DIGITS, hex);
+            printf("BBP time: %.2f seconds\n", omp_get_wtime() - bbp_start);
+        }
+        return 0;
+    }
+
+    if (output_format != DIGIT_FORMAT_TEXT && (format_output || raw_output) && !quiet_flag) {
+        fprintf(stderr, "Warning: --format and --raw only apply to text output, ignoring them.\n");
+    }
+
+    if (radix != 10 && output_format != DIGIT_FORMAT_TEXT) {
+        fprintf(stderr, "Error: --output-format %s only encodes decimal digits, it cannot be used with --radix %d\n",
+            output_format == DIGIT_FORMAT_PACKED ? "packed" : "u64", radix);
+        return 1;
+    }
+
+    // Asynchronous engines write regular files; pipes and --stdout stay on stdio
+    if (io_engine != IO_ENGINE_STDIO) {
+        if (stdout_flag) {
+            if (!quiet_flag) fprintf(stderr, "Warning: --io-engine only applies to output files, --stdout uses stdio.\n");
+        } else if (io_engine_select(io_engine) != 0) {
+            if (!quiet_flag) fprintf(stderr, "Warning: I/O engine not available on this system, using stdio.\n");
+        }
+    }
+
+    // Conversion of a binary result file, no computation
+    if (decode_file) {
+        FILE* in = fopen(decode_file, "rb");
+        if (!in) {
+            perror("Failed to open file");
+            return 1;
+        }
+        unsigned long decoded_digits;
+        double computation_time;
+        DigitDecoder* decoder = digit_decoder_open(in, &decoded_digits, &computation_time);
+        if (!decoder) {
+            fprintf(stderr, "Error: %s is not a packed or u64 digit file\n", decode_file);
+            fclose(in);
+            return 1;
+        }
+        int ret;
+        if (stdout_flag) {
+            ret = write_pi_digits_to_stream(digit_decoder_read, decoder, decoded_digits, stdout, computation_time,
+                format_output, buffer_size, raw_output, output_format);
+        } else {
+            ret = write_pi_digits_to_file(digit_decoder_read, decoder, decoded_digits, output_file, computation_time,
+                format_output, buffer_size, raw_output, output_format);
+            if (ret == 0 && !quiet_flag) {
+                printf("%lu digits decoded to %s\n", decoded_digits, output_file);
+                if (io_engine_enabled()) io_engine_report(stdout);
+            }
+        }
+        digit_decoder_close(decoder);
+        fclose(in);
+        return ret == 0 ? 0 : 1;
+    }
+
     // If both --stdout and -o are specified (and the filename is not the default), issue a warning
     if (stdout_flag && strcmp(output_file, "pi.txt") != 0 && !quiet_flag) {
         fprintf(stderr, "Warning: --stdout overrides -o, ignoring output file.\n");
@@ -160,13 +337,86 @@ int main(int argc, char* argv[]) {
         if (!quiet_flag) fprintf(stderr, "Warning: --disable-output is set, ignoring --stdout.\n");
         stdout_flag = 0;
     }
+    // From here on digits is the decimal precision of the computation and output_digits the digits to write
+    unsigned long output_digits = digits;
+    if (radix != 10) {
+        digits = (unsigned long) radix_decimal_digits(output_digits, radix);
+        if (cache_dir) {
+            if (!quiet_flag) fprintf(stderr, "Warning: --cache-dir only stores decimal results, ignoring it.\n");
+            cache_dir = NULL;
+        }
+    }
+
     // Warning when outputting large numbers to stdout
-    if (stdout_flag && digits > 100000 && !quiet_flag) {
-        fprintf(stderr, "Warning: printing %lu digits to stdout may cause terminal slowdown. Consider redirecting to a file.\n", digits);
+    if (stdout_flag && output_digits > 100000 && !quiet_flag) {
+        fprintf(stderr, "Warning: printing %lu digits to stdout may cause terminal slowdown. Consider redirecting to a file.\n", output_digits);
+    }
+
+    // The allocator has to be in place before the first GMP variable is created
+    if (strcmp(allocator, "arena") == 0 && arena_install() != 0) {
+        fprintf(stderr, "Error: cannot install the arena allocator\n");
+        return 1;
+    }
+
+    // NUMA placement applies to the workers of the series loop
+    if (numa_flag) {
+        if (strcmp(algorithm, "series") != 0) {
+            if (!quiet_flag) fprintf(stderr, "Warning: --numa only applies to --algorithm series, ignoring it.\n");
+        } else if (numa_setup(num_threads) != 0) {
+            if (!quiet_flag) fprintf(stderr, "Warning: NUMA topology not available, ignoring --numa.\n");
+        } else {
+            omp_set_dynamic(0); // Every worker ID has to exist in every block
+        }
+    }
+
+    // Out-of-core storage is only used by the binary splitting merges
+    if (swap_dir) {
+        if (strcmp(algorithm, "binsplit") != 0) {
+            if (!quiet_flag) fprintf(stderr, "Warning: --swap-dir only applies to --algorithm binsplit, ignoring it.\n");
+        } else if (swap_init(swap_dir) != 0) {
+            fprintf(stderr, "Error: cannot use swap directory %s\n", swap_dir);
+            return 1;
+        }
+    }
+
+    if (stats_file) {
+        if (stats_enable(num_threads) != 0) {
+            fprintf(stderr, "Error: Failed to allocate statistics\n");
+            return 1;
+        }
+        stats_set_run(digits, algorithm, omp_schedule, chunk_size);
+    }
+
+    // Without permission for perf events the run goes on uncounted
+    if (perf_flag && perf_enable() != 0 && !quiet_flag) {
+        fprintf(stderr, "Warning: performance counters not available (see /proc/sys/kernel/perf_event_paranoid), ignoring --perf-counters.\n");
+    }
+
+    if (trace_file && trace_enable() != 0) {
+        fprintf(stderr, "Error: Failed to allocate trace buffer\n");
+        return 1;
+    }
+
+    // A stored result with enough digits is written out without computing anything
+    DigitCacheEntry* cached = NULL;
+    if (cache_dir) {
+        if (digit_cache_init(cache_dir, cache_limit) != 0) {
+            fprintf(stderr, "Error: cannot use cache directory %s\n", cache_dir);
+            return 1;
+        }
+        cached = digit_cache_open(digits);
     }
 
     if (!quiet_flag) {
-        printf("Calculating pi to %lu digits using %d threads...\n", digits, num_threads);
+        if (cached) {
+            printf("Serving pi to %lu digits from the cache (%lu digits stored)...\n", digits,
+                digit_cache_entry_digits(cached));
+        } else if (radix != 10) {
+            printf("Calculating pi to %lu %s digits (%lu decimal digits) using %d threads...\n", output_digits,
+                radix == 16 ? "hexadecimal" : "binary", digits, num_threads);
+        } else {
+            printf("Calculating pi to %lu digits using %d threads...\n", digits, num_threads);
+        }
     }
 
     mpf_t pi;
@@ -176,38 +426,76 @@ int main(int argc, char* argv[]) {
 
     bool show_progress = progress_flag && !quiet_flag;  // Display only when not in silent mode and progress is enabled.
 
-    #ifdef ENABLE_BLOCK_FACTORIAL
-    calculate_pi(pi, digits, num_threads, omp_schedule, chunk_size, block_size,
-        show_progress, progress_freq, quiet_flag,
-        checkpoint_enable, checkpoint_freq, checkpoint_file, checkpoint_verbose);
-    #else
-    calculate_pi(pi, digits, num_threads, omp_schedule, chunk_size,
-        show_progress, progress_freq, quiet_flag,
-        checkpoint_enable, checkpoint_freq, checkpoint_file, checkpoint_verbose);
-    #endif
+    double reduction_time = 0;
+
+    PiStatus status = PI_OK;
+    if (!cached) {
+        #ifdef ENABLE_BLOCK_FACTORIAL
+        status = calculate_pi(pi, digits, algorithm, num_threads, omp_schedule, chunk_size, block_size, leaf_size,
+            show_progress, progress_freq, quiet_flag,
+            checkpoint_enable, checkpoint_freq, checkpoint_file, checkpoint_verbose, &reduction_time);
+        #else
+        status = calculate_pi(pi, digits, algorithm, num_threads, omp_schedule, chunk_size, leaf_size,
+            show_progress, progress_freq, quiet_flag,
+            checkpoint_enable, checkpoint_freq, checkpoint_file, checkpoint_verbose, &reduction_time);
+        #endif
+    }
+    if (status != PI_OK) {
+        fprintf(stderr, "Error: %s\n", pi_status_string(status));
+        mpf_clear(pi);
+        return 1;
+    }
 
     double end_time = omp_get_wtime();
 
     double total_time = end_time - start_time;
+    int exit_code = 0;
     if (!quiet_flag) {
         printf("\nTotal time: %.2f seconds\n", total_time);
+        if (!cached && strcmp(algorithm, "series") == 0) {
+            printf("Reduction time: %.2f seconds\n", reduction_time);
+        }
     }
 
     if (enable_output) {
+        perf_phase_begin();
+        double conversion_time = 0;
+        // A computed result is stored in the cache as it is written
+        bool cache_store = !cached && cache_dir && digit_cache_begin(digits) == 0;
         if (stdout_flag) {
             // Output to stdout
-            write_pi_to_stream(pi, digits, stdout, total_time, format_output, buffer_size, raw_output);
-            if (!quiet_flag) {
+            if (cached) {
+                if (write_pi_digits_to_stream(digit_cache_read, cached, digits, stdout, total_time, format_output,
+                        buffer_size, raw_output, output_format) != 0) exit_code = 1;
+            } else {
+                if (write_pi_to_stream(pi, output_digits, stdout, total_time, format_output, buffer_size, raw_output,
+                        output_format, radix, stream_output, &conversion_time) != 0) exit_code = 1;
+            }
+            if (!quiet_flag && exit_code == 0) {
                 fflush(stdout);
                 fprintf(stderr, "\nResult written to stdout\n");
+                fprintf(stderr, "Conversion time: %.2f seconds\n", conversion_time);
             }
         } else {
             // Output to file
-            write_pi_to_file(pi, digits, output_file, total_time, format_output, buffer_size, raw_output);
-            if (!quiet_flag) {
+            if (cached) {
+                if (write_pi_digits_to_file(digit_cache_read, cached, digits, output_file, total_time, format_output,
+                        buffer_size, raw_output, output_format) != 0) exit_code = 1;
+            } else {
+                if (write_pi_to_file(pi, output_digits, output_file, total_time, format_output, buffer_size, raw_output,
+                        output_format, radix, stream_output, &conversion_time) != 0) exit_code = 1;
+            }
+            if (!quiet_flag && exit_code == 0) {
                 printf("Result written to %s\n", output_file);
+                printf("Conversion time: %.2f seconds\n", conversion_time);
             }
         }
+        if (cache_store && exit_code != 0) {
+            digit_cache_discard();
+        } else if (cache_store && digit_cache_commit() == 0 && !quiet_flag) {
+            printf("Result stored in cache %s\n", cache_dir);
+        }
+        perf_phase_end(PERF_OUTPUT);
     }
 
     if (time_file) {
@@ -216,6 +504,9 @@ int main(int argc, char* argv[]) {
             perror("Failed to open time file");
         } else {
             fprintf(tf, "Total time: %.2f seconds\n", total_time);
+            if (!cached && strcmp(algorithm, "series") == 0) {
+                fprintf(tf, "Reduction time: %.2f seconds\n", reduction_time);
+            }
             fclose(tf);
             if (!quiet_flag) {
                 printf("Time written to %s\n", time_file);
@@ -223,39 +514,109 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (stats_file) {
+        if (stats_write_json(stats_file, omp_get_wtime() - start_time) != 0) {
+            perror("Failed to write stats file");
+        } else if (!quiet_flag) {
+            printf("Statistics written to %s\n", stats_file);
+        }
+    }
+
+    if (trace_file) {
+        if (trace_write(trace_file) != 0) {
+            perror("Failed to write trace file");
+        } else if (!quiet_flag) {
+            printf("Trace written to %s\n", trace_file);
+        }
+    }
+
     // Verification (if requested)
     if (verify_flag && digits >= 1000) {
-        mp_exp_t exp;
-        char* pi_str = mpf_get_str(NULL, &exp, 10, digits + 2, pi);
-        if (!pi_str || exp != 1) {
-            fprintf(stderr, "Verification failed: cannot obtain string representation.\n");
+        // Construct the complete string “3.” + the decimal part
+        char computed[1003];
+        computed[0] = '3';
+        computed[1] = '.';
+        computed[1002] = '\0';
+        bool obtained = false;
+        if (cached) {
+            obtained = digit_cache_rewind(cached) == 0 && digit_cache_read(computed + 2, 1000, cached) == 1000;
         } else {
-            // Construct the complete string “3.” + the decimal part
-            char computed[1003];
-            computed[0] = '3';
-            computed[1] = '.';
-            strncpy(computed + 2, pi_str + 1, 1000);
-            computed[1002] = '\0';
-
-            if (strcmp(computed, KNOWN_PI_1000) == 0) {
-                if (!quiet_flag) printf("Verification passed: first 1000 digits match known value.\n");
-            } else {
-                fprintf(stderr, "Verification FAILED: first 1000 digits do NOT match known value.\n");
-                fprintf(stderr, "Computed: %.1000s\n", computed);
-                fprintf(stderr, "Expected: %.1000s\n", KNOWN_PI_1000);
-                mpf_clear(pi);
-                free(pi_str);
-                return 2;
+            mp_exp_t exp;
+            char* pi_str = mpf_get_str(NULL, &exp, 10, digits + 2, pi);
+            if (pi_str && exp == 1) {
+                strncpy(computed + 2, pi_str + 1, 1000);
+                obtained = true;
             }
-            free(pi_str);
+            if (pi_str) free_gmp_str(pi_str);
+        }
+
+        if (!obtained) {
+            fprintf(stderr, "Verification failed: cannot obtain string representation.\n");
+        } else if (strcmp(computed, KNOWN_PI_1000) == 0) {
+            if (!quiet_flag) printf("Verification passed: first 1000 digits match known value.\n");
+        } else {
+            fprintf(stderr, "Verification FAILED: first 1000 digits do NOT match known value.\n");
+            fprintf(stderr, "Computed: %.1000s\n", computed);
+            fprintf(stderr, "Expected: %.1000s\n", KNOWN_PI_1000);
+            digit_cache_close(cached);
+            mpf_clear(pi);
+            return 2;
         }
     } else if (verify_flag) {
         fprintf(stderr, "Verification requires at least 1000 digits (current: %lu). Skipping.\n", digits);
     }
 
+    // The last correct hex digits of the result, against an independent formula
+    if (bbp_check && cached) {
+        if (!quiet_flag) fprintf(stderr, "Warning: --bbp-check needs a computed result, skipping it for a cached one.\n");
+    } else if (bbp_check && digits >= 40) {
+        double bbp_start = omp_get_wtime();
+        unsigned long offset = (unsigned long) (digits * log2(10) / 4) - 2 * BBP_HEX_DIGITS;
+        char computed[BBP_HEX_DIGITS + 1], expected[BBP_HEX_DIGITS + 1];
+        bbp_mpf_hex_digits(pi, offset, computed);
+        bbp_hex_digits(offset, expected);
+
+        // The last BBP digits may differ by a carry
+        if (strncmp(computed, expected, BBP_HEX_DIGITS - 2) == 0) {
+            if (!quiet_flag) {
+                printf("BBP check passed: hex digits %lu to %lu are %.*s (%.2f seconds).\n", offset + 1,
+                    offset + BBP_HEX_DIGITS - 2, BBP_HEX_DIGITS - 2, computed, omp_get_wtime() - bbp_start);
+            }
+        } else {
+            fprintf(stderr, "BBP check FAILED at hex digit %lu.\n", offset + 1);
+            fprintf(stderr, "Computed: %s\n", computed);
+            fprintf(stderr, "Expected: %s\n", expected);
+            digit_cache_close(cached);
+            mpf_clear(pi);
+            return 2;
+        }
+    } else if (bbp_check) {
+        fprintf(stderr, "BBP check requires at least 40 digits (current: %lu). Skipping.\n", digits);
+    }
+
+    if (swap_enabled() && !quiet_flag) {
+        swap_report(stdout);
+    }
+
+    if (io_engine_enabled() && !quiet_flag) {
+        io_engine_report(stdout);
+    }
+
+    if (numa_enabled() && !quiet_flag) {
+        numa_report(stdout);
+    }
+
+    if (perf_enabled() && !quiet_flag) {
+        perf_report(stdout);
+    }
+
+    if (arena_enabled() && !quiet_flag) {
+        arena_report(stdout);
+    }
 
+    digit_cache_close(cached);
     mpf_clear(pi);
 
-    return 0;
+    return exit_code;
 }
 // checkpoint
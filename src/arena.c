@@ -0,0 +1,241 @@
+// Per-thread arena allocator for GMP, installed with mp_set_memory_functions.
+//
+// Every thread owns a set of free lists, one per power-of-two size class up to
+// ARENA_MAX_CLASS_SIZE, and carves new blocks from its current slab with a bump
+// pointer. Slabs are ARENA_SLAB_SIZE bytes, aligned and advised as huge pages, and
+// are never returned. Larger blocks are mapped individually (and grown with mremap
+// on Linux). GMP passes the size of a block to free and realloc, so blocks carry
+// no header; a block freed by another thread simply joins that thread's free list.
+// No lock is taken except once per thread, to register its statistics.
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // mremap
+#endif
+
+#include "arena.h"
+#include <gmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#define ARENA_MIN_CLASS_SHIFT 4                                         // Smallest block: 16 bytes
+#define ARENA_MAX_CLASS_SHIFT 18                                        // Largest pooled block: 256 KB
+#define ARENA_CLASSES (ARENA_MAX_CLASS_SHIFT - ARENA_MIN_CLASS_SHIFT + 1)
+#define ARENA_MAX_CLASS_SIZE ((size_t) 1 << ARENA_MAX_CLASS_SHIFT)
+#define ARENA_SLAB_SIZE ((size_t) 2 << 20)                              // One 2 MB huge page
+
+#ifdef _MSC_VER
+#define ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#define ARENA_THREAD_LOCAL _Thread_local
+#endif
+
+// Allocation state and statistics of one thread
+typedef struct ArenaThread {
+    void* free_list[ARENA_CLASSES];     // Freed blocks by size class (linked through their first word)
+    char* bump;                         // Unused part of the current slab
+    size_t bump_left;
+    long long live;                     // Bytes allocated minus bytes freed by this thread
+    long long peak;                     // Largest value of live
+    unsigned long long total;           // Bytes requested over the whole run
+    unsigned long long count;           // Number of allocations
+    size_t slab_bytes;                  // Bytes of slabs taken by this thread
+    int id;
+    struct ArenaThread* next;
+} ArenaThread;
+
+static bool arena_installed = false;
+static ArenaThread* arena_threads = NULL;   // All registered threads, newest first
+static int arena_thread_count = 0;
+static ARENA_THREAD_LOCAL ArenaThread* arena_self = NULL;
+
+// Map size bytes of fresh memory (huge pages where the size allows)
+static void* arena_map(size_t size) {
+    #ifdef _WIN32
+    return malloc(size);
+    #else
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    #ifdef MADV_HUGEPAGE
+    if (size >= ARENA_SLAB_SIZE) madvise(p, size, MADV_HUGEPAGE);
+    #endif
+    return p;
+    #endif
+}
+
+static void arena_unmap(void* p, size_t size) {
+    #ifdef _WIN32
+    (void) size;
+    free(p);
+    #else
+    munmap(p, size);
+    #endif
+}
+
+// A slab aligned to its size, so it can be backed by a single huge page
+static void* arena_map_slab(void) {
+    #ifdef _WIN32
+    return malloc(ARENA_SLAB_SIZE);
+    #else
+    char* p = (char*) mmap(NULL, 2 * ARENA_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+
+    // Trim the mapping to an aligned slab
+    size_t head = (ARENA_SLAB_SIZE - (uintptr_t) p % ARENA_SLAB_SIZE) % ARENA_SLAB_SIZE;
+    if (head > 0) munmap(p, head);
+    munmap(p + head + ARENA_SLAB_SIZE, ARENA_SLAB_SIZE - head);
+    p += head;
+
+    #ifdef MADV_HUGEPAGE
+    madvise(p, ARENA_SLAB_SIZE, MADV_HUGEPAGE);
+    #endif
+    return p;
+    #endif
+}
+
+// State of the calling thread, registered on first use
+static ArenaThread* arena_thread(void) {
+    if (arena_self) return arena_self;
+
+    ArenaThread* self = (ArenaThread*) calloc(1, sizeof(ArenaThread));
+    if (!self) {
+        fprintf(stderr, "Error: Failed to allocate arena state\n");
+        exit(1);
+    }
+
+    #pragma omp critical (arena_register)
+    {
+        self->id = arena_thread_count++;
+        self->next = arena_threads;
+        arena_threads = self;
+    }
+
+    arena_self = self;
+    return self;
+}
+
+// Size class of a block of size bytes (size <= ARENA_MAX_CLASS_SIZE)
+static int arena_class(size_t size) {
+    int c = 0;
+    while (((size_t) 1 << (c + ARENA_MIN_CLASS_SHIFT)) < size) c++;
+    return c;
+}
+
+static void arena_count(ArenaThread* self, size_t size) {
+    self->live += (long long) size;
+    if (self->live > self->peak) self->peak = self->live;
+    self->total += size;
+    self->count++;
+}
+
+static void* arena_alloc(size_t size) {
+    ArenaThread* self = arena_thread();
+    arena_count(self, size);
+
+    if (size > ARENA_MAX_CLASS_SIZE) {
+        void* p = arena_map(size);
+        if (!p) {
+            fprintf(stderr, "Error: Failed to allocate %zu bytes\n", size);
+            exit(1);
+        }
+        return p;
+    }
+
+    int c = arena_class(size);
+    void* p = self->free_list[c];
+    if (p) {
+        self->free_list[c] = *(void**) p;
+        return p;
+    }
+
+    size_t block = (size_t) 1 << (c + ARENA_MIN_CLASS_SHIFT);
+    if (self->bump_left < block) {
+        // The rest of the old slab is given up
+        self->bump = (char*) arena_map_slab();
+        if (!self->bump) {
+            fprintf(stderr, "Error: Failed to allocate an arena slab\n");
+            exit(1);
+        }
+        self->bump_left = ARENA_SLAB_SIZE;
+        self->slab_bytes += ARENA_SLAB_SIZE;
+    }
+
+    p = self->bump;
+    self->bump += block;
+    self->bump_left -= block;
+    return p;
+}
+
+static void arena_free(void* p, size_t size) {
+    ArenaThread* self = arena_thread();
+    self->live -= (long long) size;
+
+    if (size > ARENA_MAX_CLASS_SIZE) {
+        arena_unmap(p, size);
+        return;
+    }
+
+    int c = arena_class(size);
+    *(void**) p = self->free_list[c];
+    self->free_list[c] = p;
+}
+
+static void* arena_realloc(void* p, size_t old_size, size_t new_size) {
+    // Same block class: nothing to move
+    if (old_size <= ARENA_MAX_CLASS_SIZE && new_size <= ARENA_MAX_CLASS_SIZE &&
+        arena_class(old_size) == arena_class(new_size)) {
+        ArenaThread* self = arena_thread();
+        self->live -= (long long) old_size;
+        arena_count(self, new_size);
+        return p;
+    }
+
+    #if defined(__linux__)
+    // Large blocks are remapped instead of copied
+    if (old_size > ARENA_MAX_CLASS_SIZE && new_size > ARENA_MAX_CLASS_SIZE) {
+        void* q = mremap(p, old_size, new_size, MREMAP_MAYMOVE);
+        if (q == MAP_FAILED) {
+            fprintf(stderr, "Error: Failed to reallocate %zu bytes\n", new_size);
+            exit(1);
+        }
+        ArenaThread* self = arena_thread();
+        self->live -= (long long) old_size;
+        arena_count(self, new_size);
+        return q;
+    }
+    #endif
+
+    void* q = arena_alloc(new_size);
+    memcpy(q, p, old_size < new_size ? old_size : new_size);
+    arena_free(p, old_size);
+    return q;
+}
+
+// Route all GMP allocations through per-thread arenas
+int arena_install(void) {
+    mp_set_memory_functions(arena_alloc, arena_realloc, arena_free);
+    arena_installed = true;
+    return 0;
+}
+
+// Whether arena_install succeeded
+bool arena_enabled(void) {
+    return arena_installed;
+}
+
+// Print the peak and total allocated bytes of every thread that used the arena
+void arena_report(FILE* out) {
+    fprintf(out, "Arena allocator statistics:\n");
+
+    // The list is newest first; print in registration order
+    for (int id = 0; id < arena_thread_count; id++) {
+        for (ArenaThread* t = arena_threads; t; t = t->next) {
+            if (t->id != id) continue;
+            fprintf(out, "  Thread %3d: peak %10.2f MB, total %12.2f MB in %llu allocations, slabs %8.2f MB\n",
+                    t->id, t->peak / 1048576.0, t->total / 1048576.0, t->count, t->slab_bytes / 1048576.0);
+        }
+    }
+}
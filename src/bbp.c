@@ -0,0 +1,109 @@
+// Hexadecimal digit extraction with the Bailey-Borwein-Plouffe formula
+//
+//   pi = sum_k 16^-k (4/(8k+1) - 2/(8k+4) - 1/(8k+5) - 1/(8k+6))
+//
+// The digits after position d are the fractional part of 16^d pi. For each of the four
+// sums, the terms k <= d contribute (16^(d-k) mod (8k+j)) / (8k+j) modulo 1, and the
+// terms k > d a quickly vanishing tail. The sum is kept in [0, 1) after every term, so
+// the rounding error stays near sqrt(d) ulps and the first BBP_HEX_DIGITS are reliable
+// far beyond the offsets of any decimal run.
+
+#include "bbp.h"
+#include <math.h>
+#include <stdint.h>
+#include <omp.h>
+
+// a * b mod m for a, b < m
+static uint64_t mul_mod(uint64_t a, uint64_t b, uint64_t m) {
+    if (m <= UINT32_MAX) return a * b % m; // Offsets below 2^29 hex digits
+    #ifdef __SIZEOF_INT128__
+    return (uint64_t) ((unsigned __int128) a * b % m);
+    #else
+    uint64_t result = 0;
+    a %= m;
+    while (b) {
+        if (b & 1) result = result >= m - a ? result - (m - a) : result + a;
+        a = a >= m - a ? a - (m - a) : a + a;
+        b >>= 1;
+    }
+    return result;
+    #endif
+}
+
+// 16^e mod m
+static uint64_t pow16_mod(uint64_t e, uint64_t m) {
+    if (m == 1) return 0;
+    uint64_t result = 1, base = 16 % m;
+    while (e) {
+        if (e & 1) result = mul_mod(result, base, m);
+        base = mul_mod(base, base, m);
+        e >>= 1;
+    }
+    return result;
+}
+
+// Fractional part of sum_k 16^(d-k) / (8k+j)
+static double bbp_series(uint64_t d, int j) {
+    double s = 0;
+
+    // Terms k <= d, split over the threads
+    #pragma omp parallel for schedule(static) reduction(+:s)
+    for (int64_t k = 0; k <= (int64_t) d; k++) {
+        uint64_t m = 8 * (uint64_t) k + j;
+        s += (double) pow16_mod(d - (uint64_t) k, m) / (double) m;
+        s -= floor(s);
+    }
+    s -= floor(s);
+
+    // Tail k > d, until the terms no longer change the sum
+    double p = 1.0 / 16;
+    for (uint64_t k = d + 1; ; k++) {
+        double t = p / (double) (8 * k + j);
+        if (t < 1e-17) break;
+        s += t;
+        p /= 16;
+    }
+    return s - floor(s);
+}
+
+static void put_hex(double frac, char* hex) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (int i = 0; i < BBP_HEX_DIGITS; i++) {
+        frac *= 16;
+        int digit = (int) frac;
+        hex[i] = digits[digit];
+        frac -= digit;
+    }
+    hex[BBP_HEX_DIGITS] = '\0';
+}
+
+// Hex digits offset+1 .. offset+BBP_HEX_DIGITS of pi
+void bbp_hex_digits(unsigned long offset, char* hex) {
+    double x = 4 * bbp_series(offset, 1) - 2 * bbp_series(offset, 4)
+        - bbp_series(offset, 5) - bbp_series(offset, 6);
+    put_hex(x - floor(x), hex);
+}
+
+// The same hex digits of a computed value
+void bbp_mpf_hex_digits(const mpf_t x, unsigned long offset, char* hex) {
+    mpf_t scaled, integer;
+    mpf_init2(scaled, mpf_get_prec(x));
+    mpf_init2(integer, mpf_get_prec(x));
+
+    // Fractional part of x * 16^offset, then its first hex digits as an integer
+    mpf_mul_2exp(scaled, x, 4 * (mp_bitcnt_t) offset);
+    mpf_floor(integer, scaled);
+    mpf_sub(scaled, scaled, integer);
+    mpf_mul_2exp(scaled, scaled, 4 * BBP_HEX_DIGITS);
+    mpf_floor(scaled, scaled);
+
+    static const char digits[] = "0123456789ABCDEF";
+    unsigned long value = mpf_get_ui(scaled);
+    for (int i = BBP_HEX_DIGITS - 1; i >= 0; i--) {
+        hex[i] = digits[value & 15];
+        value >>= 4;
+    }
+    hex[BBP_HEX_DIGITS] = '\0';
+
+    mpf_clears(scaled, integer, NULL);
+}
@@ -0,0 +1,380 @@
+// Binary splitting evaluation of the Chudnovsky series.
+//
+// With p(0) = q(0) = 1 and, for k >= 1,
+//     p(k) = (6k-5)(2k-1)(6k-1)
+//     q(k) = k^3 * 640320^3 / 24
+// the partial products and sums over a range [a, b) are
+//     P(a,b) = p(a) ... p(b-1)
+//     Q(a,b) = q(a) ... q(b-1)
+//     T(a,b) = sum_{k=a}^{b-1} (-1)^k (13591409 + 545140134k) P(a,k+1) Q(k+1,b)
+// and two adjacent ranges [a,m), [m,b) are merged as
+//     P = P(a,m) P(m,b), Q = Q(a,m) Q(m,b), T = Q(m,b) T(a,m) + P(a,m) T(m,b).
+// The series sum S = T(0,N) / Q(0,N) is the same S accumulated term by term in pi.c.
+//
+// Independent subtrees are OpenMP tasks, so idle threads pick up pending subtrees while
+// others are still merging; the multiplications of a large merge are tasks as well.
+//
+// With a swap directory, the top levels compute their halves one after the other
+// and keep the finished left half on disk while the right half is computed and
+// while the merge products are formed (see swap.c).
+
+#include "binsplit.h"
+#include "swap.h"
+#include "stats.h"
+#include "trace.h"
+#include <stdio.h>
+#include <omp.h>
+
+// Initialize a node
+void binsplit_node_init(BinsplitNode* node) {
+    mpz_inits(node->P, node->Q, node->T, NULL);
+}
+
+// Clean up a node
+void binsplit_node_clear(BinsplitNode* node) {
+    mpz_clears(node->P, node->Q, node->T, NULL);
+}
+
+// Leaf size used when none is given: enough tasks per thread to balance the tree
+unsigned long binsplit_default_leaf_size(unsigned long iterations, int num_threads) {
+    if (num_threads <= 1) return iterations;
+
+    unsigned long leaf_size = iterations / ((unsigned long) num_threads * 64);
+    return leaf_size < 32 ? 32 : leaf_size;
+}
+
+// Count finished terms and print progress the same way the series loop does
+static void binsplit_report(BinsplitContext* ctx, unsigned long terms) {
+    if (!ctx->show_progress) return;
+
+    unsigned long long before;
+    #pragma omp atomic capture
+    { before = ctx->completed; ctx->completed += terms; }
+
+    unsigned long long after = before + terms;
+    if (after / ctx->progress_freq != before / ctx->progress_freq) {
+        fprintf(stderr, "\rProgress: %.2f%%", (double) after / ctx->iterations * 100);
+        fflush(stderr);
+    }
+}
+
+// p(k) = (6k-5)(2k-1)(6k-1), p(0) = 1
+static void binsplit_p(mpz_t p, unsigned long k) {
+    if (k == 0) {
+        mpz_set_ui(p, 1);
+        return;
+    }
+    mpz_set_ui(p, 6 * k - 5);
+    mpz_mul_ui(p, p, 2 * k - 1);
+    mpz_mul_ui(p, p, 6 * k - 1);
+}
+
+// q(k) = k^3 * 640320^3 / 24 = k^3 * 26680 * 640320^2, q(0) = 1
+static void binsplit_q(mpz_t q, unsigned long k) {
+    if (k == 0) {
+        mpz_set_ui(q, 1);
+        return;
+    }
+    mpz_set_ui(q, k);
+    mpz_mul_ui(q, q, k);
+    mpz_mul_ui(q, q, k);
+    mpz_mul_ui(q, q, 26680);
+    mpz_mul_ui(q, q, 640320);
+    mpz_mul_ui(q, q, 640320);
+}
+
+// rop = a * b streamed from disk; if that fails, a is read back whole and multiplied in memory.
+// Returns -1 only if a cannot be read at all
+static int binsplit_swap_mul(mpz_t rop, const SwapInt* a, const mpz_t b) {
+    if (swap_mul(rop, a, b) == 0) return 0;
+    if (swap_in(rop, a) != 0) return -1;
+    mpz_mul(rop, rop, b);
+    return 0;
+}
+
+// Merge a range out-of-core: the left half is spilled before the right half is computed.
+// Returns 0 when merged, 1 (with node still holding the left half) if the left half could not be
+// spilled, -1 if a spilled operand could not be read back
+static int binsplit_compute_swapped(unsigned long m, unsigned long b, BinsplitNode* node, bool need_P,
+    BinsplitContext* ctx) {
+    SwapInt left_P, left_Q, left_T;
+    if (swap_out(&left_T, node->T) != 0) return 1;
+    if (swap_out(&left_Q, node->Q) != 0) {
+        int ret = swap_in(node->T, &left_T) != 0 ? -1 : 1;
+        swap_release(&left_T);
+        return ret;
+    }
+    if (swap_out(&left_P, node->P) != 0) {
+        int ret = swap_in(node->T, &left_T) != 0 || swap_in(node->Q, &left_Q) != 0 ? -1 : 1;
+        swap_release(&left_T);
+        swap_release(&left_Q);
+        return ret;
+    }
+
+    BinsplitNode right;
+    binsplit_node_init(&right);
+    int ret = binsplit_compute(m, b, &right, need_P, ctx);
+
+    // T = Q(m,b) * T(a,m) + P(a,m) * T(m,b), one product at a time to keep the peak low
+    if (ret == 0) ret = binsplit_swap_mul(node->T, &left_T, right.Q);
+    swap_release(&left_T);
+    if (ret == 0) ret = binsplit_swap_mul(node->Q, &left_Q, right.Q);
+    swap_release(&left_Q);
+    if (ret == 0) ret = binsplit_swap_mul(right.Q, &left_P, right.T);
+    if (ret == 0) mpz_add(node->T, node->T, right.Q);
+    if (ret == 0 && need_P) {
+        ret = binsplit_swap_mul(node->P, &left_P, right.P);
+    }
+    swap_release(&left_P);
+    binsplit_node_clear(&right);
+
+    if (ret != 0) {
+        if (!ctx->quiet) fprintf(stderr, "Error: out-of-core merge of [%lu, %lu) failed\n", m, b);
+        return -1;
+    }
+    return 0;
+}
+
+// Compute P(a,b), Q(a,b) and T(a,b) recursively (P is skipped if need_P is false)
+// Inside a parallel region, subtrees larger than ctx->leaf_size are run as OpenMP tasks.
+// Returns 0, or -1 if an out-of-core merge failed (node is then unusable)
+int binsplit_compute(unsigned long a, unsigned long b, BinsplitNode* node, bool need_P,
+    BinsplitContext* ctx) {
+    if (b - a == 1) {
+        binsplit_p(node->P, a);
+        binsplit_q(node->Q, a);
+
+        // T = (-1)^a * p(a) * (13591409 + 545140134a)
+        mpz_set_ui(node->T, 545140134);
+        mpz_mul_ui(node->T, node->T, a);
+        mpz_add_ui(node->T, node->T, 13591409);
+        mpz_mul(node->T, node->T, node->P);
+        if (a & 1) mpz_neg(node->T, node->T);
+
+        binsplit_report(ctx, 1);
+        return 0;
+    }
+
+    unsigned long m = a + (b - a) / 2;
+
+    if (ctx->swap_threshold && b - a >= ctx->swap_threshold) {
+        // Top of the tree: halves in sequence (each one parallel inside), merged from disk
+        if (binsplit_compute(a, m, node, true, ctx) != 0) return -1;
+        int ret = binsplit_compute_swapped(m, b, node, need_P, ctx);
+        if (ret <= 0) return ret;
+
+        if (!ctx->quiet) fprintf(stderr, "Warning: cannot spill to the swap directory, continuing in memory\n");
+        ctx->swap_threshold = 0;
+
+        BinsplitNode right;
+        binsplit_node_init(&right);
+        if (binsplit_compute(m, b, &right, need_P, ctx) != 0) {
+            binsplit_node_clear(&right);
+            return -1;
+        }
+        mpz_mul(node->T, node->T, right.Q);
+        mpz_mul(right.T, node->P, right.T);
+        mpz_add(node->T, node->T, right.T);
+        mpz_mul(node->Q, node->Q, right.Q);
+        if (need_P) {
+            mpz_mul(node->P, node->P, right.P);
+        }
+        binsplit_node_clear(&right);
+        return 0;
+    }
+
+    BinsplitNode right;
+    binsplit_node_init(&right);
+    int ret = 0;
+
+    if (b - a <= ctx->leaf_size) {
+        // Serial subtree
+        ret = binsplit_compute(a, m, node, true, ctx);
+        if (ret == 0) ret = binsplit_compute(m, b, &right, need_P, ctx);
+        if (ret != 0) {
+            binsplit_node_clear(&right);
+            return ret;
+        }
+
+        // T = Q(m,b) * T(a,m) + P(a,m) * T(m,b)
+        mpz_mul(node->T, node->T, right.Q);
+        mpz_mul(right.T, node->P, right.T);
+        mpz_add(node->T, node->T, right.T);
+
+        mpz_mul(node->Q, node->Q, right.Q);
+        if (need_P) {
+            mpz_mul(node->P, node->P, right.P);
+        }
+    } else {
+        // The left half is left to any idle thread, the right half is computed here
+        int left_ret = 0;
+        #pragma omp task default(none) firstprivate(a, m, node, ctx) shared(left_ret)
+        left_ret = binsplit_compute(a, m, node, true, ctx);
+
+        ret = binsplit_compute(m, b, &right, need_P, ctx);
+
+        #pragma omp taskwait
+
+        if (left_ret != 0) ret = left_ret;
+        if (ret == 0) binsplit_merge(node, &right, need_P);
+    }
+
+    binsplit_node_clear(&right);
+    return ret;
+}
+
+// Merge the adjacent range right into node (right is clobbered)
+void binsplit_merge(BinsplitNode* node, BinsplitNode* right, bool need_P) {
+    // Each product writes a different operand, so the four of them can run concurrently
+    #pragma omp task default(none) firstprivate(node, right)
+    mpz_mul(node->T, node->T, right->Q);      // Q(m,b) * T(a,m)
+
+    #pragma omp task default(none) firstprivate(node, right)
+    mpz_mul(right->T, node->P, right->T);     // P(a,m) * T(m,b)
+
+    #pragma omp task default(none) firstprivate(node, right)
+    mpz_mul(node->Q, node->Q, right->Q);
+
+    if (need_P) {
+        #pragma omp task default(none) firstprivate(node, right)
+        mpz_mul(right->P, node->P, right->P);
+    }
+
+    #pragma omp taskwait
+
+    mpz_add(node->T, node->T, right->T);
+    if (need_P) {
+        mpz_swap(node->P, right->P);
+    }
+}
+
+// pi = C * Q / T of the whole series; node is cleared. Returns -1 if T cannot be read back
+static int binsplit_divide(mpf_t pi, const mpf_t C, BinsplitNode* node, BinsplitContext* ctx) {
+    double start = omp_get_wtime();
+    mpf_t temp;
+    mpf_init2(temp, mpf_get_prec(pi));
+
+    // Q and T are longer than the working precision; keep only one of them whole at a time
+    SwapInt spilled_T;
+    bool spilled = ctx->swap_threshold && swap_out(&spilled_T, node->T) == 0;
+
+    mpf_set_z(pi, node->Q);
+    mpz_clear(node->Q);
+    mpz_init(node->Q);
+    mpf_mul(pi, pi, C);
+
+    if (spilled) {
+        int ret = swap_in(node->T, &spilled_T);
+        swap_release(&spilled_T);
+        if (ret != 0) {
+            mpf_clear(temp);
+            binsplit_node_clear(node);
+            return -1;
+        }
+    }
+    mpf_set_z(temp, node->T);
+    mpz_clear(node->T);
+    mpz_init(node->T);
+    mpf_div(pi, pi, temp);
+
+    mpf_clear(temp);
+    binsplit_node_clear(node);
+    stats_add_time(STATS_DIVISION, omp_get_wtime() - start);
+    if (trace_enabled()) trace_span("division", start, omp_get_wtime(), 0, 0);
+    return 0;
+}
+
+// Evaluate the whole series [0, iterations) and set pi = C * Q / T
+int binsplit_pi(mpf_t pi, const mpf_t C, unsigned long iterations, BinsplitContext* ctx) {
+    BinsplitNode node;
+    binsplit_node_init(&node);
+    double start = omp_get_wtime();
+
+    int ret = 0;
+    #pragma omp parallel default(none) shared(node, iterations, ctx, ret)
+    #pragma omp single
+    ret = binsplit_compute(0, iterations, &node, false, ctx);
+
+    if (ret != 0) {
+        binsplit_node_clear(&node);
+        return ret;
+    }
+
+    double series = omp_get_wtime() - start;
+    stats_add_time(STATS_SERIES, series);
+    stats_add_block(0, iterations, series, 0);
+    if (trace_enabled()) trace_span("binsplit tree", start, start + series, 0, iterations);
+
+    return binsplit_divide(pi, C, &node, ctx);
+}
+
+// Initialize an empty stack
+void binsplit_stack_init(BinsplitStack* stack) {
+    stack->count = 0;
+}
+
+// Clean up the nodes left on a stack
+void binsplit_stack_clear(BinsplitStack* stack) {
+    for (int i = 0; i < stack->count; i++) {
+        binsplit_node_clear(&stack->node[i]);
+    }
+    stack->count = 0;
+}
+
+// Number of terms covered by the stack
+unsigned long binsplit_stack_end(const BinsplitStack* stack) {
+    return stack->count > 0 ? stack->end[stack->count - 1] : 0;
+}
+
+// Push the finished subtree [binsplit_stack_end(stack), end); node is moved into the stack.
+// Neighbours are merged while the left one is not larger than the right one, which keeps
+// the stack logarithmic and the merges balanced
+void binsplit_stack_push(BinsplitStack* stack, unsigned long end, BinsplitNode* node) {
+    int top = stack->count++;
+    binsplit_node_init(&stack->node[top]);
+    mpz_swap(stack->node[top].P, node->P);
+    mpz_swap(stack->node[top].Q, node->Q);
+    mpz_swap(stack->node[top].T, node->T);
+    stack->end[top] = end;
+
+    while (stack->count >= 2) {
+        int right = stack->count - 1;
+        unsigned long start = right >= 2 ? stack->end[right - 2] : 0;
+        unsigned long left_size = stack->end[right - 1] - start;
+        unsigned long right_size = stack->end[right] - stack->end[right - 1];
+        if (left_size > right_size && stack->count < BINSPLIT_STACK_SIZE) break;
+
+        BinsplitNode* left_node = &stack->node[right - 1];
+        BinsplitNode* right_node = &stack->node[right];
+
+        #pragma omp parallel default(none) shared(left_node, right_node)
+        #pragma omp single
+        binsplit_merge(left_node, right_node, true);
+
+        binsplit_node_clear(right_node);
+        stack->end[right - 1] = stack->end[right];
+        stack->count--;
+    }
+}
+
+// Merge everything on the stack (which must cover the whole series) and set pi = C * Q / T
+int binsplit_stack_pi(mpf_t pi, const mpf_t C, BinsplitStack* stack, BinsplitContext* ctx) {
+    double start = omp_get_wtime();
+    for (int right = stack->count - 1; right > 0; right--) {
+        BinsplitNode* left_node = &stack->node[right - 1];
+        BinsplitNode* right_node = &stack->node[right];
+
+        #pragma omp parallel default(none) shared(left_node, right_node)
+        #pragma omp single
+        binsplit_merge(left_node, right_node, false);
+
+        binsplit_node_clear(right_node);
+        stack->count--;
+    }
+    stats_add_time(STATS_SERIES, omp_get_wtime() - start);
+    if (trace_enabled()) trace_span("binsplit merge", start, omp_get_wtime(), 0, 0);
+
+    int ret = binsplit_divide(pi, C, &stack->node[0], ctx);
+    stack->count = 0;
+    return ret;
+}
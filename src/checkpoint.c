@@ -1,15 +1,60 @@
-// Note: This implementation relies on GMP's internal structure (e.g., _mp_exp, _mp_size, _mp_d).
-// If you upgrade GMP to a version that changes these internal layouts, checkpoint files may become incompatible.
-// It is recommended to regenerate checkpoint files after upgrading GMP.
+// Checkpoint file format, version 2 (all fields little-endian):
+//
+//   header   64 bytes: "PICK", version (u8), 3 reserved, digits (u64), num_threads (u32),
+//            flags (u32), section count (u32), CRC-32C of bytes 0..27 (u32), 32 reserved
+//   section  id (u32), CRC-32C of the payload (u32), payload length (u64), 8 reserved,
+//            then the payload, padded to a multiple of 8 bytes
+//
+// The series algorithm writes a STATE and a SUM section. The binary splitting algorithm
+// writes a manifest with a TREE section listing its finished subtrees, and one node file
+// "<checkpoint>.node.<a>-<b>" with the P, Q and T of each subtree; a node file is written
+// once, when its subtree is finished, and removed when it is merged into a larger one.
+//
+// Big numbers are stored as a sign, a binary exponent and mpz_export-style 64-bit words,
+// least significant first, so the files do not depend on the platform or on GMP internals.
+// Loading maps the file and imports the words straight from the mapping.
+//
+// Version 1 files (raw _mp_exp/_mp_d dumps) can still be loaded; that path relies on GMP's
+// internal mpf layout and on the writing platform having the same long size.
 
 #include "checkpoint.h"
+#include "crc32c.h"
+#include "trace.h"
 #include <math.h>
+#include <omp.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
-// Head Structure (Internal Use)
+#define CHECKPOINT_VERSION      2
+#define CHECKPOINT_HEADER_SIZE  64
+#define SECTION_HEADER_SIZE     24
+#define INTEGER_HEAD_SIZE       24
+
+// Section identifiers
+#define SECTION_STATE   1   // completed_k (u64)
+#define SECTION_SUM     2   // global_S (integer payload)
+#define SECTION_TREE    3   // Manifest: count (u64), then the end of each finished subtree (u64)
+#define SECTION_RANGE   4   // Node: a, b (u64)
+#define SECTION_P       5   // Node: P(a,b) (integer payload)
+#define SECTION_Q       6   // Node: Q(a,b)
+#define SECTION_T       7   // Node: T(a,b)
+
+#define CHECKPOINT_MAX_SECTIONS 8
+
+// Version 1 head structure (legacy loading only)
 typedef struct {
     char     magic[4];          // "PICK"
-    uint8_t  version;           // The current value is 1
+    uint8_t  version;           // 1
     uint8_t  reserved[3];       // Alignment
     uint64_t digits;            // Target digit
     uint32_t num_threads;       // Number of threads
@@ -17,23 +62,228 @@ typedef struct {
     uint8_t  future[32];        // reserved
 } checkpoint_header_t;
 
-// Adjust precision to suit current computational requirements
-static int mpf_out_raw(FILE *fp, const mpf_t x) {
-    // Write exp
-    long exp = x->_mp_exp;
-    if (fwrite(&exp, sizeof(exp), 1, fp) != 1)
-        return 0;
+// A section located inside a loaded file
+typedef struct {
+    uint32_t id;
+    const unsigned char* payload;
+    uint64_t length;
+} checkpoint_section_t;
 
-    // Write the tail number disguised as mpz_t
-    mpz_t mantissa;
-    mantissa->_mp_alloc = x->_mp_size;
-    mantissa->_mp_size = x->_mp_size;
-    mantissa->_mp_d = x->_mp_d;
+// Little-endian encoding helpers
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// Whether GMP limbs can be written and read as they are (64-bit limbs on a little-endian host)
+static bool limbs_are_words(void) {
+    const uint16_t probe = 1;
+    return GMP_NUMB_BITS == 64 && sizeof(mp_limb_t) == 8 && *(const unsigned char*) &probe == 1;
+}
+
+// Split x into an integer mantissa M and a binary exponent: x = M * 2^exp2
+static void mpf_to_integer(mpz_t M, int64_t* exp2, const mpf_t x) {
+    if (mpf_sgn(x) == 0) {
+        mpz_set_ui(M, 0);
+        *exp2 = 0;
+        return;
+    }
+
+    // Enough bits for every limb x holds, so the conversion is exact
+    mp_bitcnt_t bits = mpf_get_prec(x) + 2 * GMP_NUMB_BITS;
+    long e;
+    mpf_get_d_2exp(&e, x); // |x| = d * 2^e with 0.5 <= d < 1
+
+    mpf_t scaled;
+    mpf_init2(scaled, bits);
+    if ((long) bits >= e) {
+        mpf_mul_2exp(scaled, x, (mp_bitcnt_t) ((long) bits - e));
+    } else {
+        mpf_div_2exp(scaled, x, (mp_bitcnt_t) (e - (long) bits));
+    }
+    mpz_set_f(M, scaled);
+    mpf_clear(scaled);
+
+    *exp2 = (int64_t) e - (int64_t) bits;
+}
+
+// x = M * 2^exp2 (rounded to the precision of x)
+static void integer_to_mpf(mpf_t x, const mpz_t M, int64_t exp2) {
+    mpf_set_z(x, M);
+    if (exp2 >= 0) {
+        mpf_mul_2exp(x, x, (mp_bitcnt_t) exp2);
+    } else {
+        mpf_div_2exp(x, x, (mp_bitcnt_t) -exp2);
+    }
+}
+
+// Write one section: header, head + body as the payload, padding
+static int write_section(FILE* fp, uint32_t id, const void* head, size_t head_len,
+    const void* body, size_t body_len) {
+    uint32_t crc = crc32c(0, head, head_len);
+    if (body_len > 0) crc = crc32c(crc, body, body_len);
+
+    unsigned char header[SECTION_HEADER_SIZE] = { 0 };
+    uint64_t length = (uint64_t) head_len + body_len;
+    put_u32(header, id);
+    put_u32(header + 4, crc);
+    put_u64(header + 8, length);
+
+    static const unsigned char padding[8] = { 0 };
+    size_t pad = (size_t) ((8 - length % 8) % 8);
+    if (fwrite(header, 1, sizeof(header), fp) != sizeof(header) ||
+        fwrite(head, 1, head_len, fp) != head_len ||
+        (body_len > 0 && fwrite(body, 1, body_len, fp) != body_len) ||
+        (pad > 0 && fwrite(padding, 1, pad, fp) != pad)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Write M * 2^exp2 as a section: sign (u32), reserved (u32), exp2 (i64), word count (u64), words
+static int write_integer_section(FILE* fp, uint32_t id, const mpz_t M, int64_t exp2) {
+    size_t count = (mpz_sizeinbase(M, 2) + 63) / 64;
+    if (mpz_sgn(M) == 0) count = 0;
+
+    unsigned char head[INTEGER_HEAD_SIZE] = { 0 };
+    put_u32(head, (uint32_t) (mpz_sgn(M) + 1)); // 0 = negative, 1 = zero, 2 = positive
+    put_u64(head + 8, (uint64_t) exp2);
+    put_u64(head + 16, count);
+
+    if (limbs_are_words()) {
+        // The limbs already are the words
+        return write_section(fp, id, head, sizeof(head), mpz_limbs_read(M), count * 8);
+    }
 
-    return mpz_out_raw(fp, mantissa) + sizeof(exp);
+    unsigned char* words = (unsigned char*) malloc(count > 0 ? count * 8 : 1);
+    if (!words) return -1;
+    memset(words, 0, count * 8);
+    mpz_export(words, NULL, -1, 8, -1, 0, M);
+    int ret = write_section(fp, id, head, sizeof(head), words, count * 8);
+    free(words);
+    return ret;
 }
 
-// Custom mpf_t binary input
+// Read an integer section written by write_integer_section
+static int read_integer_section(const checkpoint_section_t* section, mpz_t M, int64_t* exp2) {
+    if (section->length < INTEGER_HEAD_SIZE) return -1;
+
+    uint32_t sign = get_u32(section->payload);
+    uint64_t count = get_u64(section->payload + 16);
+    if (sign > 2 || count > (section->length - INTEGER_HEAD_SIZE) / 8) return -1;
+
+    // Import straight from the mapped file
+    mpz_import(M, (size_t) count, -1, 8, -1, 0, section->payload + INTEGER_HEAD_SIZE);
+    if (sign == 0) mpz_neg(M, M);
+    if (exp2) *exp2 = (int64_t) get_u64(section->payload + 8);
+    return 0;
+}
+
+// A checkpoint file mapped (or, without mmap, read) into memory
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    #ifdef _WIN32
+    unsigned char* buffer;
+    #endif
+} mapped_file_t;
+
+// Map a whole file read-only. Returns -1 if it does not exist, -2 on other errors
+static int map_file(const char* filename, mapped_file_t* file) {
+    #ifdef _WIN32
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return -1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    file->buffer = (unsigned char*) malloc(size > 0 ? (size_t) size : 1);
+    if (size < 0 || !file->buffer || fread(file->buffer, 1, (size_t) size, fp) != (size_t) size) {
+        free(file->buffer);
+        fclose(fp);
+        return -2;
+    }
+    fclose(fp);
+    file->data = file->buffer;
+    file->size = (size_t) size;
+    return 0;
+    #else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -2;
+    }
+
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -2;
+    madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    file->data = (const unsigned char*) data;
+    file->size = (size_t) st.st_size;
+    return 0;
+    #endif
+}
+
+static void unmap_file(mapped_file_t* file) {
+    #ifdef _WIN32
+    free(file->buffer);
+    #else
+    munmap((void*) file->data, file->size);
+    #endif
+}
+
+// Check the header and every section checksum of a version 2 file.
+// Fills sections (up to max_sections) and returns the section count, or -1 if the file is corrupt
+static int parse_checkpoint(const mapped_file_t* file, checkpoint_section_t* sections, int max_sections,
+    uint64_t* digits, uint32_t* num_threads, uint32_t* flags) {
+    const unsigned char* p = file->data;
+    if (file->size < CHECKPOINT_HEADER_SIZE || crc32c(0, p, 28) != get_u32(p + 28)) return -1;
+
+    *digits = get_u64(p + 8);
+    *num_threads = get_u32(p + 16);
+    *flags = get_u32(p + 20);
+    uint32_t count = get_u32(p + 24);
+    if (count > (uint32_t) max_sections) return -1;
+
+    size_t offset = CHECKPOINT_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        if (file->size - offset < SECTION_HEADER_SIZE) return -1;
+        const unsigned char* header = p + offset;
+        uint64_t length = get_u64(header + 8);
+        offset += SECTION_HEADER_SIZE;
+        if (length > file->size - offset) return -1;
+
+        if (crc32c(0, p + offset, (size_t) length) != get_u32(header + 4)) return -1;
+
+        sections[i].id = get_u32(header);
+        sections[i].payload = p + offset;
+        sections[i].length = length;
+        offset += (size_t) length;
+        offset += (size_t) ((8 - length % 8) % 8);
+        if (offset > file->size) return -1;
+    }
+    return (int) count;
+}
+
+// Legacy version 1 mpf_t binary input
 static int mpf_inp_raw(FILE *fp, mpf_t x) {
     long exp;
     if (fread(&exp, sizeof(exp), 1, fp) != 1)
@@ -51,57 +301,122 @@ static int mpf_inp_raw(FILE *fp, mpf_t x) {
     return 1;
 }
 
-// Save checkpoint
-int save_checkpoint(const char* filename, unsigned long completed_k, const mpf_t global_S,
-    unsigned long digits, uint32_t num_threads, uint32_t flags, bool quiet_flag) {
-    FILE* fp = fopen(filename, "wb");
-    if (!fp) {
-        if (!quiet_flag) perror("Warning: Failed to open checkpoint file for writing");
-        return -1;
-    }
+// Flush a file all the way to the disk
+static int sync_file(FILE* fp) {
+    if (fflush(fp) != 0) return -1;
+    #ifdef _WIN32
+    return _commit(_fileno(fp));
+    #else
+    return fsync(fileno(fp));
+    #endif
+}
 
-    // Write to header
-    checkpoint_header_t header;
-    memcpy(header.magic, "PICK", 4);
-    header.version = 1;
-    memset(header.reserved, 0, sizeof(header.reserved));
-    header.digits = digits;
-    header.num_threads = num_threads;
-    header.flags = flags;
-    memset(header.future, 0, sizeof(header.future));
-
-    // Write platform information
-    uint32_t ulong_size = sizeof(unsigned long);
-    uint32_t long_size = sizeof(long);
-    memcpy(header.future, &ulong_size, 4);
-    memcpy(header.future + 4, &long_size, 4);
-
-    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+// Atomically replace filename with tmp_path
+static int replace_file(const char* tmp_path, const char* filename) {
+    #ifdef _WIN32
+    return MoveFileExA(tmp_path, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+    #else
+    return rename(tmp_path, filename);
+    #endif
+}
+
+// Write the checkpoint header
+static int write_header(FILE* fp, unsigned long digits, uint32_t num_threads, uint32_t flags,
+    uint32_t section_count) {
+    unsigned char header[CHECKPOINT_HEADER_SIZE] = { 0 };
+    memcpy(header, "PICK", 4);
+    header[4] = CHECKPOINT_VERSION;
+    put_u64(header + 8, digits);
+    put_u32(header + 16, num_threads);
+    put_u32(header + 20, flags);
+    put_u32(header + 24, section_count);
+    put_u32(header + 28, crc32c(0, header, 28));
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header) ? 0 : -1;
+}
+
+// Contents of a partial sum checkpoint
+typedef struct {
+    unsigned long completed_k;
+    const __mpf_struct* global_S;
+} sum_contents_t;
+
+// Write the checkpoint contents to an open file
+static int write_checkpoint(FILE* fp, const void* arg, unsigned long digits, uint32_t num_threads,
+    uint32_t flags, bool quiet_flag) {
+    const sum_contents_t* contents = (const sum_contents_t*) arg;
+    if (write_header(fp, digits, num_threads, flags, 2) != 0) {
         if (!quiet_flag) perror("Warning: Failed to write checkpoint header");
-        fclose(fp);
         return -1;
     }
 
     // Number of iterations completed
-    if (fwrite(&completed_k, sizeof(completed_k), 1, fp) != 1) {
+    unsigned char state[8];
+    put_u64(state, contents->completed_k);
+    if (write_section(fp, SECTION_STATE, state, sizeof(state), NULL, 0) != 0) {
         if (!quiet_flag) perror("Warning: Failed to write completed_k to checkpoint");
-        fclose(fp);
         return -1;
     }
 
-    // Write to the global section and (GMP raw format)
-    if (mpf_out_raw(fp, global_S) == 0) {
+    // Global sum as sign, exponent and words
+    mpz_t mantissa;
+    int64_t exp2;
+    mpz_init(mantissa);
+    mpf_to_integer(mantissa, &exp2, contents->global_S);
+    int ret = write_integer_section(fp, SECTION_SUM, mantissa, exp2);
+    mpz_clear(mantissa);
+    if (ret != 0) {
         if (!quiet_flag) fprintf(stderr, "Warning: Failed to write global_S to checkpoint\n");
-        fclose(fp);
         return -1;
     }
 
-    fclose(fp);
     return 0;
 }
 
-// Load checkpoint
-int load_checkpoint(const char* filename, unsigned long* completed_k, mpf_t global_S,
+typedef int (*write_contents_fn)(FILE* fp, const void* arg, unsigned long digits, uint32_t num_threads,
+    uint32_t flags, bool quiet_flag);
+
+// Write a file through write_fn into a temporary file, sync it and rename it over filename
+static int save_atomically(const char* filename, write_contents_fn write_fn, const void* arg,
+    unsigned long digits, uint32_t num_threads, uint32_t flags, bool quiet_flag) {
+    // The previous checkpoint stays intact until the new one is completely on disk
+    size_t tmp_len = strlen(filename) + 5;
+    char* tmp_path = (char*) malloc(tmp_len);
+    if (!tmp_path) return -1;
+    snprintf(tmp_path, tmp_len, "%s.tmp", filename);
+
+    FILE* fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        if (!quiet_flag) perror("Warning: Failed to open checkpoint file for writing");
+        free(tmp_path);
+        return -1;
+    }
+
+    int ret = write_fn(fp, arg, digits, num_threads, flags, quiet_flag);
+    if (ret == 0 && sync_file(fp) != 0) {
+        if (!quiet_flag) perror("Warning: Failed to sync checkpoint file");
+        ret = -1;
+    }
+    if (fclose(fp) != 0) ret = -1;
+
+    if (ret == 0 && replace_file(tmp_path, filename) != 0) {
+        if (!quiet_flag) perror("Warning: Failed to replace checkpoint file");
+        ret = -1;
+    }
+    if (ret != 0) remove(tmp_path);
+
+    free(tmp_path);
+    return ret;
+}
+
+// Save checkpoint (written to a temporary file, synced and renamed over filename)
+int save_checkpoint(const char* filename, unsigned long completed_k, const mpf_t global_S,
+    unsigned long digits, uint32_t num_threads, uint32_t flags, bool quiet_flag) {
+    sum_contents_t contents = { completed_k, global_S };
+    return save_atomically(filename, write_checkpoint, &contents, digits, num_threads, flags, quiet_flag);
+}
+
+// Load a version 1 checkpoint
+static int load_checkpoint_v1(const char* filename, unsigned long* completed_k, mpf_t global_S,
     unsigned long req_digits, uint32_t* num_threads, uint32_t* flags, bool quiet_flag) {
     FILE* fp = fopen(filename, "rb");
     if (!fp) {
@@ -148,7 +463,6 @@ int load_checkpoint(const char* filename, unsigned long* completed_k, mpf_t glob
         fclose(fp);
         return -2;
     }
-
     // Number of output threads and flags
     if (num_threads) *num_threads = header.num_threads;
     if (flags) *flags = header.flags;
@@ -174,3 +488,403 @@ int load_checkpoint(const char* filename, unsigned long* completed_k, mpf_t glob
 
     return 0;
 }
+
+// Map a version 2 file, verify all of its checksums and its digit count.
+// Returns the section count, -1 if the file does not exist, -2 if it is invalid
+// and -3 if it is a version 1 file
+static int open_checkpoint(const char* filename, mapped_file_t* file, checkpoint_section_t* sections,
+    unsigned long req_digits, uint32_t* num_threads, uint32_t* flags, bool quiet_flag) {
+    int ret = map_file(filename, file);
+    if (ret == -1) {
+        // File not found is not an error; it is handled by the caller.
+        return -1;
+    }
+    if (ret != 0) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Failed to read checkpoint file\n");
+        return -2;
+    }
+
+    // Verify Magic Number and Version
+    if (file->size < 5 || memcmp(file->data, "PICK", 4) != 0 ||
+        (file->data[4] != 1 && file->data[4] != CHECKPOINT_VERSION)) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Invalid checkpoint file (magic/version mismatch)\n");
+        unmap_file(file);
+        return -2;
+    }
+    if (file->data[4] == 1) {
+        unmap_file(file);
+        return -3;
+    }
+
+    // Every checksum is verified before anything is used
+    uint64_t saved_digits;
+    int count = parse_checkpoint(file, sections, CHECKPOINT_MAX_SECTIONS, &saved_digits, num_threads, flags);
+    if (count < 0) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint file is corrupted (checksum mismatch)\n");
+        unmap_file(file);
+        return -2;
+    }
+
+    // Verify that the number of digits matches
+    if (saved_digits != req_digits) {
+        if (!quiet_flag) {
+            fprintf(stderr, "Warning: Checkpoint digits mismatch (saved=%llu, requested=%lu)\n",
+                    (unsigned long long) saved_digits, req_digits);
+        }
+        unmap_file(file);
+        return -2;
+    }
+
+    return count;
+}
+
+// Load checkpoint
+int load_checkpoint(const char* filename, unsigned long* completed_k, mpf_t global_S,
+    unsigned long req_digits, uint32_t* num_threads, uint32_t* flags, bool quiet_flag) {
+    mapped_file_t file;
+    checkpoint_section_t sections[CHECKPOINT_MAX_SECTIONS];
+    uint32_t saved_threads, saved_flags;
+    int count = open_checkpoint(filename, &file, sections, req_digits, &saved_threads, &saved_flags, quiet_flag);
+    if (count == -3) {
+        return load_checkpoint_v1(filename, completed_k, global_S, req_digits, num_threads, flags, quiet_flag);
+    }
+    if (count < 0) return count;
+
+    // Number of output threads and flags
+    if (num_threads) *num_threads = saved_threads;
+    if (flags) *flags = saved_flags;
+
+    bool have_state = false, have_sum = false, have_tree = false;
+    mpf_set_prec(global_S, (req_digits + 2) * log2(10));
+    for (int i = 0; i < count; i++) {
+        if (sections[i].id == SECTION_STATE && sections[i].length >= 8) {
+            *completed_k = (unsigned long) get_u64(sections[i].payload);
+            have_state = true;
+        } else if (sections[i].id == SECTION_SUM) {
+            mpz_t mantissa;
+            int64_t exp2;
+            mpz_init(mantissa);
+            if (read_integer_section(&sections[i], mantissa, &exp2) == 0) {
+                integer_to_mpf(global_S, mantissa, exp2);
+                have_sum = true;
+            }
+            mpz_clear(mantissa);
+        } else if (sections[i].id == SECTION_TREE) {
+            have_tree = true;
+        }
+        // Unknown sections are skipped
+    }
+    unmap_file(&file);
+
+    if (have_tree) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint file holds a binary splitting tree (use --algorithm binsplit)\n");
+        return -2;
+    }
+    if (!have_state || !have_sum) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint file is missing completed_k or global_S\n");
+        return -2;
+    }
+
+    return 0;
+}
+
+// Path of the node file of the subtree [a, b)
+static char* node_path(const char* filename, unsigned long a, unsigned long b) {
+    size_t len = strlen(filename) + 64;
+    char* path = (char*) malloc(len);
+    if (path) snprintf(path, len, "%s.node.%lu-%lu", filename, a, b);
+    return path;
+}
+
+// Contents of a node file
+typedef struct {
+    unsigned long a, b;
+    const __mpz_struct *P, *Q, *T;
+} node_contents_t;
+
+// Write a node file to an open file
+static int write_node(FILE* fp, const void* arg, unsigned long digits, uint32_t num_threads,
+    uint32_t flags, bool quiet_flag) {
+    const node_contents_t* node = (const node_contents_t*) arg;
+    unsigned char range[16];
+    put_u64(range, node->a);
+    put_u64(range + 8, node->b);
+
+    if (write_header(fp, digits, num_threads, flags, 4) != 0 ||
+        write_section(fp, SECTION_RANGE, range, sizeof(range), NULL, 0) != 0 ||
+        write_integer_section(fp, SECTION_P, node->P, 0) != 0 ||
+        write_integer_section(fp, SECTION_Q, node->Q, 0) != 0 ||
+        write_integer_section(fp, SECTION_T, node->T, 0) != 0) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Failed to write checkpoint node [%lu, %lu)\n", node->a, node->b);
+        return -1;
+    }
+    return 0;
+}
+
+// Save the P, Q and T of the finished subtree [a, b) to its node file
+int save_checkpoint_node(const char* filename, unsigned long a, unsigned long b,
+    const mpz_t P, const mpz_t Q, const mpz_t T, unsigned long digits, bool quiet_flag) {
+    char* path = node_path(filename, a, b);
+    if (!path) return -1;
+
+    node_contents_t contents = { a, b, P, Q, T };
+    int ret = save_atomically(path, write_node, &contents, digits, 0, 0, quiet_flag);
+    free(path);
+    return ret;
+}
+
+// Load the node file of the subtree [a, b)
+int load_checkpoint_node(const char* filename, unsigned long a, unsigned long b,
+    mpz_t P, mpz_t Q, mpz_t T, unsigned long req_digits, bool quiet_flag) {
+    char* path = node_path(filename, a, b);
+    if (!path) return -2;
+
+    mapped_file_t file;
+    checkpoint_section_t sections[CHECKPOINT_MAX_SECTIONS];
+    uint32_t num_threads, flags;
+    int count = open_checkpoint(path, &file, sections, req_digits, &num_threads, &flags, quiet_flag);
+    free(path);
+    if (count == -3) return -2;
+    if (count < 0) return count;
+
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        const checkpoint_section_t* section = &sections[i];
+        if (section->id == SECTION_RANGE && section->length >= 16) {
+            if (get_u64(section->payload) == a && get_u64(section->payload + 8) == b) found |= 1;
+        } else if (section->id == SECTION_P && read_integer_section(section, P, NULL) == 0) {
+            found |= 2;
+        } else if (section->id == SECTION_Q && read_integer_section(section, Q, NULL) == 0) {
+            found |= 4;
+        } else if (section->id == SECTION_T && read_integer_section(section, T, NULL) == 0) {
+            found |= 8;
+        }
+    }
+    unmap_file(&file);
+
+    if (found != 15) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint node [%lu, %lu) is incomplete\n", a, b);
+        return -2;
+    }
+    return 0;
+}
+
+// Delete the node file of the subtree [a, b)
+void remove_checkpoint_node(const char* filename, unsigned long a, unsigned long b) {
+    char* path = node_path(filename, a, b);
+    if (path) remove(path);
+    free(path);
+}
+
+// Contents of a manifest
+typedef struct {
+    const unsigned long* ends;
+    int count;
+} manifest_contents_t;
+
+// Write a manifest to an open file
+static int write_manifest(FILE* fp, const void* arg, unsigned long digits, uint32_t num_threads,
+    uint32_t flags, bool quiet_flag) {
+    const manifest_contents_t* manifest = (const manifest_contents_t*) arg;
+    unsigned char* tree = (unsigned char*) malloc(8 * ((size_t) manifest->count + 1));
+    if (!tree) return -1;
+
+    put_u64(tree, (uint64_t) manifest->count);
+    for (int i = 0; i < manifest->count; i++) {
+        put_u64(tree + 8 * (i + 1), manifest->ends[i]);
+    }
+
+    int ret = 0;
+    if (write_header(fp, digits, num_threads, flags, 1) != 0 ||
+        write_section(fp, SECTION_TREE, tree, 8 * ((size_t) manifest->count + 1), NULL, 0) != 0) {
+        if (!quiet_flag) perror("Warning: Failed to write checkpoint manifest");
+        ret = -1;
+    }
+    free(tree);
+    return ret;
+}
+
+// Save the list of finished subtrees
+int save_checkpoint_manifest(const char* filename, const unsigned long* ends, int count,
+    unsigned long digits, uint32_t num_threads, uint32_t flags, bool quiet_flag) {
+    manifest_contents_t contents = { ends, count };
+    return save_atomically(filename, write_manifest, &contents, digits, num_threads, flags, quiet_flag);
+}
+
+// Load the list of finished subtrees
+int load_checkpoint_manifest(const char* filename, unsigned long* ends, int* count, int max_count,
+    unsigned long req_digits, uint32_t* num_threads, uint32_t* flags, bool quiet_flag) {
+    mapped_file_t file;
+    checkpoint_section_t sections[CHECKPOINT_MAX_SECTIONS];
+    uint32_t saved_threads, saved_flags;
+    int section_count = open_checkpoint(filename, &file, sections, req_digits, &saved_threads, &saved_flags,
+                                        quiet_flag);
+    if (section_count == -1) return -1;
+    if (section_count == -3) section_count = -2; // Version 1 files hold a partial sum
+    if (section_count >= 0) {
+        int i = 0;
+        while (i < section_count && sections[i].id != SECTION_TREE) i++;
+
+        if (i == section_count || sections[i].length < 8) {
+            if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint file holds a partial sum (use --algorithm series)\n");
+            section_count = -2;
+        } else {
+            const checkpoint_section_t* tree = &sections[i];
+            uint64_t n = get_u64(tree->payload);
+            if (n > (uint64_t) max_count || n > (tree->length - 8) / 8) {
+                if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint manifest is too large\n");
+                section_count = -2;
+            } else {
+                for (uint64_t j = 0; j < n; j++) {
+                    ends[j] = (unsigned long) get_u64(tree->payload + 8 * (j + 1));
+                }
+                *count = (int) n;
+                if (num_threads) *num_threads = saved_threads;
+                if (flags) *flags = saved_flags;
+            }
+        }
+        unmap_file(&file);
+    }
+
+    return section_count < 0 ? section_count : 0;
+}
+
+// Background checkpoint writer.
+// Two snapshot slots: "pending" is filled by the computing thread, "writing" belongs to the
+// I/O thread. Submitting only copies global_S into the pending slot; the I/O thread swaps the
+// slots and writes without holding the lock, so the next block is computed meanwhile.
+struct CheckpointWriter {
+    char* filename;
+    unsigned long digits;
+    uint32_t num_threads;
+    uint32_t flags;
+    bool quiet_flag;
+    bool verbose;
+
+    mpf_t pending, writing;         // Snapshot slots
+    unsigned long pending_k;
+    bool has_pending;
+    bool started;                   // Whether pending has been sized yet
+    #ifndef _WIN32
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    #endif
+};
+
+// Write one snapshot and report the result
+static void checkpoint_writer_write(CheckpointWriter* writer, unsigned long completed_k, const mpf_t S) {
+    double start = trace_enabled() ? omp_get_wtime() : 0;
+    int ret = save_checkpoint(writer->filename, completed_k, S, writer->digits,
+                              writer->num_threads, writer->flags, writer->quiet_flag);
+    if (trace_enabled()) trace_span("checkpoint write", start, omp_get_wtime(), 0, completed_k);
+
+    if (ret != 0) {
+        if (!writer->quiet_flag) fprintf(stderr, "Warning: Failed to save checkpoint\n");
+    } else if (writer->verbose && !writer->quiet_flag) {
+        fprintf(stderr, "\nCheckpoint saved at iteration %lu\n", completed_k);
+    }
+}
+
+#ifndef _WIN32
+// I/O thread: write the newest snapshot until stopped
+static void* checkpoint_writer_main(void* arg) {
+    CheckpointWriter* writer = (CheckpointWriter*) arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (!writer->has_pending && !writer->stop) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (!writer->has_pending) break; // Stopped with nothing left to write
+
+        mpf_swap(writer->pending, writer->writing);
+        unsigned long completed_k = writer->pending_k;
+        writer->has_pending = false;
+        pthread_mutex_unlock(&writer->lock);
+
+        checkpoint_writer_write(writer, completed_k, writer->writing);
+
+        pthread_mutex_lock(&writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+#endif
+
+// Start the writer thread for checkpoints of one computation
+CheckpointWriter* checkpoint_writer_create(const char* filename, unsigned long digits, uint32_t num_threads,
+    uint32_t flags, bool quiet_flag, bool verbose) {
+    CheckpointWriter* writer = (CheckpointWriter*) calloc(1, sizeof(CheckpointWriter));
+    if (!writer) return NULL;
+
+    writer->filename = (char*) malloc(strlen(filename) + 1);
+    if (!writer->filename) {
+        free(writer);
+        return NULL;
+    }
+    strcpy(writer->filename, filename);
+    writer->digits = digits;
+    writer->num_threads = num_threads;
+    writer->flags = flags;
+    writer->quiet_flag = quiet_flag;
+    writer->verbose = verbose;
+    mpf_inits(writer->pending, writer->writing, NULL);
+
+    #ifndef _WIN32
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    if (pthread_create(&writer->thread, NULL, checkpoint_writer_main, writer) != 0) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Failed to start checkpoint writer thread\n");
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->lock);
+        mpf_clears(writer->pending, writer->writing, NULL);
+        free(writer->filename);
+        free(writer);
+        return NULL;
+    }
+    #endif
+
+    return writer;
+}
+
+// Snapshot global_S and queue it; returns without waiting for the disk
+void checkpoint_writer_submit(CheckpointWriter* writer, unsigned long completed_k, const mpf_t global_S) {
+    #ifdef _WIN32
+    // No I/O thread on this platform: write synchronously
+    checkpoint_writer_write(writer, completed_k, global_S);
+    #else
+    pthread_mutex_lock(&writer->lock);
+    if (!writer->started) {
+        // Both slots get the full precision once, so later snapshots are plain copies
+        mpf_set_prec(writer->pending, mpf_get_prec(global_S));
+        mpf_set_prec(writer->writing, mpf_get_prec(global_S));
+        writer->started = true;
+    }
+    mpf_set(writer->pending, global_S);
+    writer->pending_k = completed_k;
+    writer->has_pending = true;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+    #endif
+}
+
+// Wait for the queued checkpoint to be written and stop the thread
+void checkpoint_writer_destroy(CheckpointWriter* writer) {
+    if (!writer) return;
+
+    #ifndef _WIN32
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = true;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->lock);
+    #endif
+
+    mpf_clears(writer->pending, writer->writing, NULL);
+    free(writer->filename);
+    free(writer);
+}
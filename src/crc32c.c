@@ -0,0 +1,73 @@
+// CRC-32C (Castagnoli polynomial 0x82F63B78).
+// Uses the SSE4.2 crc32 instruction when the compiler targets it, otherwise slicing-by-8 tables.
+
+#include "crc32c.h"
+#include <string.h>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#if !defined(__SSE4_2__)
+static uint32_t crc32c_table[8][256];
+static int crc32c_table_ready = 0;
+
+// Build the slicing-by-8 tables (idempotent, so a race between threads is harmless)
+static void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0x82F63B78U & (0U - (crc & 1)));
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
+        }
+    }
+    crc32c_table_ready = 1;
+}
+#endif
+
+// CRC-32C of a buffer, continuing from crc
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*) data;
+    crc = ~crc;
+
+    #if defined(__SSE4_2__)
+    #if defined(__x86_64__) || defined(_M_X64)
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t) crc64;
+    #endif
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    #else
+    if (!crc32c_table_ready) crc32c_init_table();
+
+    // Eight bytes at a time (little-endian load order, independent of the host)
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    #endif
+
+    return ~crc;
+}
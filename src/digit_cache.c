@@ -0,0 +1,452 @@
+// Persistent digit store for --cache-dir.
+//
+// Every result is one file "pi_<digits>.digits" in the cache directory (all fields little-endian):
+//
+//   header   32 bytes: "PIDC", version (u8), 3 reserved, digits (u64), block size (u32),
+//            block count (u32), CRC-32C of bytes 0..23 (u32), CRC-32C of the block table (u32)
+//   table    CRC-32C of each block of decimals (u32)
+//   decimals the digits after "3.", as ASCII
+//
+// A request for N digits is served from the smallest file with at least N decimals; only the
+// blocks holding the first N decimals are read and checked. A file is written under a
+// temporary name and renamed when complete, so readers never see a partial one. The
+// modification time records the last use: the least recently used files are deleted once the
+// directory holds more than the limit.
+
+#include "digit_cache.h"
+#include "crc32c.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#include <sys/utime.h>
+#define getpid _getpid
+#define utime _utime
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define DIGIT_CACHE_VERSION     1
+#define DIGIT_CACHE_HEADER_SIZE 32
+#define DIGIT_CACHE_BLOCK_SIZE  ((size_t) 1 << 20)  // Decimals per checksum
+
+struct DigitCacheEntry {
+    FILE* fp;
+    unsigned long digits;
+    long long data_offset;
+    unsigned long position;     // Decimals read so far
+};
+
+// A file of the cache directory
+typedef struct {
+    unsigned long digits;
+    long long size;
+    time_t last_used;
+} CacheFile;
+
+static char* cache_dir = NULL;                  // NULL = disabled
+static unsigned long long cache_limit = 0;
+
+// Result being stored
+static FILE* record_fp = NULL;
+static char* record_path = NULL;                // Temporary name
+static unsigned long record_digits = 0;
+static unsigned long record_written = 0;
+static uint32_t* record_crc = NULL;             // Running CRC of each block
+static bool record_failed = false;
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static size_t block_count(unsigned long digits) {
+    return (digits + DIGIT_CACHE_BLOCK_SIZE - 1) / DIGIT_CACHE_BLOCK_SIZE;
+}
+
+// Offset of the first decimal in a file of digits decimals
+static long long data_offset(unsigned long digits) {
+    return DIGIT_CACHE_HEADER_SIZE + 4 * (long long) block_count(digits);
+}
+
+// Seek to a 64-bit offset from the start of the file (long is 32 bits on Windows)
+static int seek_to(FILE* fp, long long offset) {
+    #ifdef _WIN32
+    return _fseeki64(fp, offset, SEEK_SET);
+    #else
+    return fseeko(fp, (off_t) offset, SEEK_SET);
+    #endif
+}
+
+// Path of the file holding digits decimals (suffix: appended to the name); free it
+static char* entry_path(unsigned long digits, const char* suffix) {
+    size_t len = strlen(cache_dir) + strlen(suffix) + 64;
+    char* path = (char*) malloc(len);
+    if (path) snprintf(path, len, "%s/pi_%lu.digits%s", cache_dir, digits, suffix);
+    return path;
+}
+
+// Whether name is "pi_<digits>.digits"
+static bool parse_entry_name(const char* name, unsigned long* digits) {
+    int end = 0;
+    if (sscanf(name, "pi_%lu.digits%n", digits, &end) != 1 || end == 0) return false;
+    return name[end] == '\0';
+}
+
+// Add the entry name to the list if it is one
+static int add_file(CacheFile** files, int* count, int* capacity, const char* name) {
+    unsigned long digits;
+    if (!parse_entry_name(name, &digits)) return 0;
+
+    char* path = entry_path(digits, "");
+    if (!path) return -1;
+    struct stat st;
+    int ret = stat(path, &st);
+    free(path);
+    if (ret != 0) return 0; // Removed in the meantime
+
+    if (*count == *capacity) {
+        int grown_capacity = *capacity ? 2 * *capacity : 16;
+        CacheFile* grown = (CacheFile*) realloc(*files, grown_capacity * sizeof(CacheFile));
+        if (!grown) return -1;
+        *files = grown;
+        *capacity = grown_capacity;
+    }
+    (*files)[*count].digits = digits;
+    (*files)[*count].size = (long long) st.st_size;
+    (*files)[*count].last_used = st.st_mtime;
+    ++*count;
+    return 0;
+}
+
+// List the stored results. Returns the count, or -1 on error
+static int list_files(CacheFile** files) {
+    int count = 0, capacity = 0;
+    *files = NULL;
+
+    #ifdef _WIN32
+    size_t len = strlen(cache_dir) + 16;
+    char* pattern = (char*) malloc(len);
+    if (!pattern) return -1;
+    snprintf(pattern, len, "%s/pi_*.digits", cache_dir);
+    struct _finddata_t found;
+    intptr_t handle = _findfirst(pattern, &found);
+    free(pattern);
+    if (handle == -1) return 0;
+    do {
+        if (add_file(files, &count, &capacity, found.name) != 0) {
+            _findclose(handle);
+            free(*files);
+            return -1;
+        }
+    } while (_findnext(handle, &found) == 0);
+    _findclose(handle);
+    #else
+    DIR* dir = opendir(cache_dir);
+    if (!dir) return -1;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (add_file(files, &count, &capacity, ent->d_name) != 0) {
+            closedir(dir);
+            free(*files);
+            return -1;
+        }
+    }
+    closedir(dir);
+    #endif
+
+    return count;
+}
+
+static int compare_digits(const void* a, const void* b) {
+    unsigned long x = ((const CacheFile*) a)->digits, y = ((const CacheFile*) b)->digits;
+    return (x > y) - (x < y);
+}
+
+static int compare_last_used(const void* a, const void* b) {
+    time_t x = ((const CacheFile*) a)->last_used, y = ((const CacheFile*) b)->last_used;
+    return (x > y) - (x < y);
+}
+
+// Use dir as a persistent store of computed digits
+int digit_cache_init(const char* dir, unsigned long long limit) {
+    free(cache_dir);
+    cache_dir = (char*) malloc(strlen(dir) + 1);
+    if (!cache_dir) return -1;
+    strcpy(cache_dir, dir);
+    cache_limit = limit;
+
+    // Check that the directory can be listed
+    CacheFile* files;
+    int count = list_files(&files);
+    free(files);
+    if (count < 0) {
+        free(cache_dir);
+        cache_dir = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Whether digit_cache_init succeeded
+bool digit_cache_enabled(void) {
+    return cache_dir != NULL;
+}
+
+// Check the header of a file and the blocks holding its first digits decimals.
+// Leaves fp at the first decimal
+static bool check_entry(FILE* fp, unsigned long stored, unsigned long digits) {
+    unsigned char header[DIGIT_CACHE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header)) return false;
+    if (memcmp(header, "PIDC", 4) != 0 || header[4] != DIGIT_CACHE_VERSION) return false;
+    if (crc32c(0, header, 24) != get_u32(header + 24)) return false;
+    if (get_u64(header + 8) != stored || get_u32(header + 16) != DIGIT_CACHE_BLOCK_SIZE) return false;
+
+    size_t blocks = block_count(stored);
+    if (get_u32(header + 20) != blocks) return false;
+    unsigned char* table = (unsigned char*) malloc(4 * blocks + 1);
+    char* buffer = (char*) malloc(DIGIT_CACHE_BLOCK_SIZE);
+    bool ok = table && buffer && fread(table, 4, blocks, fp) == blocks &&
+        crc32c(0, table, 4 * blocks) == get_u32(header + 28);
+
+    // Only the blocks that will be served
+    for (size_t b = 0; ok && b < block_count(digits); b++) {
+        size_t len = stored - b * DIGIT_CACHE_BLOCK_SIZE;
+        if (len > DIGIT_CACHE_BLOCK_SIZE) len = DIGIT_CACHE_BLOCK_SIZE;
+        ok = fread(buffer, 1, len, fp) == len && crc32c(0, buffer, len) == get_u32(table + 4 * b);
+    }
+
+    free(table);
+    free(buffer);
+    return ok && seek_to(fp, data_offset(stored)) == 0;
+}
+
+// Open the smallest stored result that can serve digits decimals
+DigitCacheEntry* digit_cache_open(unsigned long digits) {
+    if (!cache_dir) return NULL;
+    CacheFile* files;
+    int count = list_files(&files);
+    if (count <= 0) return NULL;
+    qsort(files, count, sizeof(CacheFile), compare_digits);
+
+    DigitCacheEntry* entry = NULL;
+    for (int i = 0; i < count && !entry; i++) {
+        if (files[i].digits < digits) continue;
+        char* path = entry_path(files[i].digits, "");
+        if (!path) break;
+
+        FILE* fp = fopen(path, "rb");
+        if (fp && check_entry(fp, files[i].digits, digits)) {
+            entry = (DigitCacheEntry*) malloc(sizeof(DigitCacheEntry));
+            if (entry) {
+                entry->fp = fp;
+                entry->digits = files[i].digits;
+                entry->data_offset = data_offset(files[i].digits);
+                entry->position = 0;
+                utime(path, NULL); // Most recently used
+            } else {
+                fclose(fp);
+            }
+        } else if (fp) {
+            fclose(fp);
+            fprintf(stderr, "Warning: cache file %s is corrupt, removing it\n", path);
+            remove(path);
+        }
+        free(path);
+    }
+
+    free(files);
+    return entry;
+}
+
+unsigned long digit_cache_entry_digits(const DigitCacheEntry* entry) {
+    return entry->digits;
+}
+
+// Read up to len decimals from the current position
+size_t digit_cache_read(char* buffer, size_t len, void* arg) {
+    DigitCacheEntry* entry = (DigitCacheEntry*) arg;
+    if (len > entry->digits - entry->position) len = entry->digits - entry->position;
+    size_t read = fread(buffer, 1, len, entry->fp);
+    entry->position += read;
+    return read;
+}
+
+// Go back to the first decimal
+int digit_cache_rewind(DigitCacheEntry* entry) {
+    entry->position = 0;
+    return seek_to(entry->fp, entry->data_offset);
+}
+
+void digit_cache_close(DigitCacheEntry* entry) {
+    if (!entry) return;
+    fclose(entry->fp);
+    free(entry);
+}
+
+// Start storing a result of digits decimals
+int digit_cache_begin(unsigned long digits) {
+    if (!cache_dir || record_fp) return -1;
+    if ((unsigned long long) data_offset(digits) + digits > cache_limit) {
+        fprintf(stderr, "Warning: %lu digits exceed the cache limit, not caching them\n", digits);
+        return -1;
+    }
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%ld", (long) getpid());
+    record_path = entry_path(digits, suffix);
+    record_crc = (uint32_t*) calloc(block_count(digits) + 1, sizeof(uint32_t));
+    if (record_path) record_fp = fopen(record_path, "wb");
+    if (!record_fp || !record_crc) {
+        if (record_fp) {
+            fclose(record_fp);
+            remove(record_path);
+        }
+        fprintf(stderr, "Warning: cannot create a cache file in %s\n", cache_dir);
+        free(record_path);
+        free(record_crc);
+        record_fp = NULL;
+        record_path = NULL;
+        record_crc = NULL;
+        return -1;
+    }
+
+    // The header is written by digit_cache_commit, once the checksums are known
+    record_digits = digits;
+    record_written = 0;
+    record_failed = seek_to(record_fp, data_offset(digits)) != 0;
+    return 0;
+}
+
+// Whether a result is being stored
+bool digit_cache_recording(void) {
+    return record_fp != NULL;
+}
+
+// Append decimals to the result being stored
+void digit_cache_append(const char* digits, size_t len) {
+    if (!record_fp || record_failed) return;
+    if (len > record_digits - record_written) {
+        record_failed = true;
+        return;
+    }
+    if (fwrite(digits, 1, len, record_fp) != len) {
+        record_failed = true;
+        return;
+    }
+
+    // Continue the checksum of each block the piece touches
+    while (len > 0) {
+        size_t block = record_written / DIGIT_CACHE_BLOCK_SIZE;
+        size_t room = DIGIT_CACHE_BLOCK_SIZE - record_written % DIGIT_CACHE_BLOCK_SIZE;
+        size_t n = len < room ? len : room;
+        record_crc[block] = crc32c(record_crc[block], digits, n);
+        record_written += n;
+        digits += n;
+        len -= n;
+    }
+}
+
+// Delete the least recently used results until the directory fits the limit; keep is never deleted
+static void evict(unsigned long keep) {
+    CacheFile* files;
+    int count = list_files(&files);
+    if (count <= 0) return;
+    qsort(files, count, sizeof(CacheFile), compare_last_used);
+
+    unsigned long long total = 0;
+    for (int i = 0; i < count; i++) total += (unsigned long long) files[i].size;
+    for (int i = 0; i < count && total > cache_limit; i++) {
+        if (files[i].digits == keep) continue;
+        char* path = entry_path(files[i].digits, "");
+        if (path && remove(path) == 0) total -= (unsigned long long) files[i].size;
+        free(path);
+    }
+    free(files);
+}
+
+// Finish the stored result and evict over the limit
+int digit_cache_commit(void) {
+    if (!record_fp) return -1;
+
+    bool ok = !record_failed && record_written == record_digits;
+    if (ok) {
+        size_t blocks = block_count(record_digits);
+        unsigned char* table = (unsigned char*) malloc(4 * blocks + 1);
+        ok = table != NULL;
+        if (ok) {
+            for (size_t b = 0; b < blocks; b++) put_u32(table + 4 * b, record_crc[b]);
+
+            unsigned char header[DIGIT_CACHE_HEADER_SIZE] = { 0 };
+            memcpy(header, "PIDC", 4);
+            header[4] = DIGIT_CACHE_VERSION;
+            put_u64(header + 8, record_digits);
+            put_u32(header + 16, (uint32_t) DIGIT_CACHE_BLOCK_SIZE);
+            put_u32(header + 20, (uint32_t) blocks);
+            put_u32(header + 24, crc32c(0, header, 24));
+            put_u32(header + 28, crc32c(0, table, 4 * blocks));
+
+            ok = seek_to(record_fp, 0) == 0 &&
+                fwrite(header, 1, sizeof(header), record_fp) == sizeof(header) &&
+                fwrite(table, 4, blocks, record_fp) == blocks;
+            free(table);
+        }
+    }
+    ok = fclose(record_fp) == 0 && ok;
+    record_fp = NULL;
+
+    if (ok) {
+        char* path = entry_path(record_digits, "");
+        #ifdef _WIN32
+        if (path) remove(path); // rename does not replace on Windows
+        #endif
+        ok = path && rename(record_path, path) == 0;
+        free(path);
+    }
+    if (!ok) {
+        fprintf(stderr, "Warning: failed to store %lu digits in the cache\n", record_digits);
+        remove(record_path);
+    }
+
+    free(record_path);
+    free(record_crc);
+    record_path = NULL;
+    record_crc = NULL;
+
+    if (!ok) return -1;
+    evict(record_digits);
+    return 0;
+}
+
+// Drop the result being stored
+void digit_cache_discard(void) {
+    if (!record_fp) return;
+    fclose(record_fp);
+    record_fp = NULL;
+    remove(record_path);
+
+    free(record_path);
+    free(record_crc);
+    record_path = NULL;
+    record_crc = NULL;
+}
@@ -0,0 +1,262 @@
+// Binary encodings of the output digits, for --output-format and --decode.
+//
+// packed stores two digits per byte and u64 19 digits per little-endian word (10^19 < 2^64),
+// 0.5 and 0.42 bytes per digit against at least 1 for text. The conversions run 16 digits
+// at a time with SSE2 (part of every x86-64 target) and fall back to scalar code elsewhere:
+// packing is a shift and a saturating pack, u64 words are built by three multiply-add
+// rounds (digit pairs, groups of 4, groups of 8) and split back into digits with the
+// multiply-high division by powers of ten.
+
+#include "digit_format.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DIGIT_FORMAT_SSE2
+#endif
+
+#define DIGIT_FORMAT_VERSION 1
+#define DECODER_GROUPS 4096     // Groups decoded per refill
+
+struct DigitDecoder {
+    FILE* fp;
+    DigitFormat format;
+    unsigned long remaining;    // Digits not handed out yet
+    unsigned char* in;
+    char* out;
+    size_t out_len, out_pos;
+};
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// Parse a format name
+int digit_format_parse(const char* name, DigitFormat* format) {
+    if (strcmp(name, "text") == 0) {
+        *format = DIGIT_FORMAT_TEXT;
+    } else if (strcmp(name, "packed") == 0) {
+        *format = DIGIT_FORMAT_PACKED;
+    } else if (strcmp(name, "u64") == 0) {
+        *format = DIGIT_FORMAT_U64;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Digits per encoded group
+size_t digit_format_group_digits(DigitFormat format) {
+    return format == DIGIT_FORMAT_U64 ? DIGIT_FORMAT_U64_DIGITS : 2;
+}
+
+// Bytes per encoded group
+size_t digit_format_group_bytes(DigitFormat format) {
+    return format == DIGIT_FORMAT_U64 ? 8 : 1;
+}
+
+// Fill the header of a binary file
+void digit_format_header(unsigned char* header, DigitFormat format, unsigned long digits, double computation_time) {
+    memset(header, 0, DIGIT_FORMAT_HEADER_SIZE);
+    memcpy(header, "PIDF", 4);
+    header[4] = DIGIT_FORMAT_VERSION;
+    header[5] = (unsigned char) format;
+    put_u64(header + 8, digits);
+    uint64_t time_bits;
+    memcpy(&time_bits, &computation_time, sizeof(time_bits));
+    put_u64(header + 16, time_bits);
+}
+
+// Two digits per byte
+static void encode_packed(const char* digits, size_t count, unsigned char* out) {
+    size_t i = 0;
+    #ifdef DIGIT_FORMAT_SSE2
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i high_mask = _mm_set1_epi16(0x00F0);
+    for (; i + 8 <= count; i += 8) {
+        // Each 16-bit lane holds a pair: first digit in the low byte, second in the high byte
+        __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) (digits + 2 * i)), zero_char);
+        __m128i pair = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(d, 4), high_mask), _mm_srli_epi16(d, 8));
+        _mm_storel_epi64((__m128i*) (out + i), _mm_packus_epi16(pair, pair));
+    }
+    #endif
+    for (; i < count; i++) {
+        out[i] = (unsigned char) ((digits[2 * i] - '0') << 4 | (digits[2 * i + 1] - '0'));
+    }
+}
+
+static void decode_packed(const unsigned char* in, size_t count, char* out) {
+    size_t i = 0;
+    #ifdef DIGIT_FORMAT_SSE2
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    for (; i + 8 <= count; i += 8) {
+        __m128i b = _mm_loadl_epi64((const __m128i*) (in + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(b, 4), nibble);
+        __m128i low = _mm_and_si128(b, nibble);
+        _mm_storeu_si128((__m128i*) (out + 2 * i), _mm_add_epi8(_mm_unpacklo_epi8(high, low), zero_char));
+    }
+    #endif
+    for (; i < count; i++) {
+        out[2 * i] = (char) ('0' + (in[i] >> 4));
+        out[2 * i + 1] = (char) ('0' + (in[i] & 15));
+    }
+}
+
+// Value of 16 ASCII digits
+static uint64_t parse16(const char* digits) {
+    #ifdef DIGIT_FORMAT_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) digits), _mm_set1_epi8('0'));
+    // Pairs, groups of 4, groups of 8 (16-bit multiply-adds of (10, 1), (100, 1), (10000, 1))
+    __m128i pairs = _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(d, zero), _mm_set1_epi32(0x0001000A)),
+        _mm_madd_epi16(_mm_unpackhi_epi8(d, zero), _mm_set1_epi32(0x0001000A)));
+    __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00010064));
+    __m128i octs = _mm_madd_epi16(_mm_packs_epi32(quads, quads), _mm_set1_epi32(0x00012710));
+    uint64_t high = (uint32_t) _mm_cvtsi128_si32(octs);
+    uint64_t low = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(octs, 4));
+    return high * 100000000ULL + low;
+    #else
+    uint64_t v = 0;
+    for (int i = 0; i < 16; i++) v = v * 10 + (uint64_t) (digits[i] - '0');
+    return v;
+    #endif
+}
+
+// The 16 digits of v < 10^16
+static void format16(uint64_t v, char* out) {
+    #ifdef DIGIT_FORMAT_SSE2
+    // Both halves of 8 digits: abcd and efgh by a multiply-high division by 10^4, then
+    // every prefix (a, ab, abc, abcd) by multiply-high divisions by 10^3 .. 10^0, and
+    // each digit as prefix - 10 * shorter prefix
+    const __m128i div10000 = _mm_set1_epi32((int) 0xd1b71759);
+    const __m128i mul10000 = _mm_set1_epi32(10000);
+    const __m128i div_powers = _mm_setr_epi16(8389, 5243, 13108, (short) 32768, 8389, 5243, 13108, (short) 32768);
+    const __m128i shift_powers = _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, (short) (1 << 15),
+        1 << 7, 1 << 11, 1 << 13, (short) (1 << 15));
+    const __m128i ten = _mm_set1_epi16(10);
+    __m128i halves[2];
+    uint32_t parts[2] = { (uint32_t) (v / 100000000), (uint32_t) (v % 100000000) };
+    for (int h = 0; h < 2; h++) {
+        __m128i abcdefgh = _mm_cvtsi32_si128((int) parts[h]);
+        __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, div10000), 45);
+        __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, mul10000));
+        __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+        __m128i v2 = _mm_unpacklo_epi16(v1, v1);
+        v2 = _mm_unpacklo_epi32(v2, v2);
+        __m128i prefixes = _mm_mulhi_epu16(_mm_mulhi_epu16(v2, div_powers), shift_powers);
+        halves[h] = _mm_sub_epi16(prefixes, _mm_slli_epi64(_mm_mullo_epi16(prefixes, ten), 16));
+    }
+    __m128i digits = _mm_add_epi8(_mm_packus_epi16(halves[0], halves[1]), _mm_set1_epi8('0'));
+    _mm_storeu_si128((__m128i*) out, digits);
+    #else
+    for (int i = 15; i >= 0; i--) {
+        out[i] = (char) ('0' + v % 10);
+        v /= 10;
+    }
+    #endif
+}
+
+// 19 digits per little-endian word
+static void encode_u64(const char* digits, size_t count, unsigned char* out) {
+    for (size_t i = 0; i < count; i++) {
+        const char* d = digits + DIGIT_FORMAT_U64_DIGITS * i;
+        uint64_t v = parse16(d) * 1000 + (uint64_t) ((d[16] - '0') * 100 + (d[17] - '0') * 10 + (d[18] - '0'));
+        put_u64(out + 8 * i, v);
+    }
+}
+
+static void decode_u64(const unsigned char* in, size_t count, char* out) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t v = get_u64(in + 8 * i);
+        char* d = out + DIGIT_FORMAT_U64_DIGITS * i;
+        format16(v / 1000, d);
+        unsigned last = (unsigned) (v % 1000);
+        d[16] = (char) ('0' + last / 100);
+        d[17] = (char) ('0' + last / 10 % 10);
+        d[18] = (char) ('0' + last % 10);
+    }
+}
+
+// Encode count groups of ASCII digits
+size_t digit_format_encode(DigitFormat format, const char* digits, size_t count, unsigned char* out) {
+    if (format == DIGIT_FORMAT_U64) {
+        encode_u64(digits, count, out);
+    } else {
+        encode_packed(digits, count, out);
+    }
+    return count * digit_format_group_bytes(format);
+}
+
+// Decode count groups into ASCII digits
+size_t digit_format_decode(DigitFormat format, const unsigned char* in, size_t count, char* out) {
+    if (format == DIGIT_FORMAT_U64) {
+        decode_u64(in, count, out);
+    } else {
+        decode_packed(in, count, out);
+    }
+    return count * digit_format_group_digits(format);
+}
+
+// Read the header of a binary file
+DigitDecoder* digit_decoder_open(FILE* fp, unsigned long* digits, double* computation_time) {
+    unsigned char header[DIGIT_FORMAT_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header)) return NULL;
+    if (memcmp(header, "PIDF", 4) != 0 || header[4] != DIGIT_FORMAT_VERSION) return NULL;
+    if (header[5] != DIGIT_FORMAT_PACKED && header[5] != DIGIT_FORMAT_U64) return NULL;
+
+    DigitDecoder* decoder = (DigitDecoder*) calloc(1, sizeof(DigitDecoder));
+    if (!decoder) return NULL;
+    decoder->fp = fp;
+    decoder->format = (DigitFormat) header[5];
+    decoder->remaining = (unsigned long) get_u64(header + 8);
+    decoder->in = (unsigned char*) malloc(DECODER_GROUPS * digit_format_group_bytes(decoder->format));
+    decoder->out = (char*) malloc(DECODER_GROUPS * digit_format_group_digits(decoder->format));
+    if (!decoder->in || !decoder->out) {
+        digit_decoder_close(decoder);
+        return NULL;
+    }
+
+    uint64_t time_bits = get_u64(header + 16);
+    memcpy(computation_time, &time_bits, sizeof(time_bits));
+    *digits = decoder->remaining;
+    return decoder;
+}
+
+// Read the next len decimals
+size_t digit_decoder_read(char* buffer, size_t len, void* arg) {
+    DigitDecoder* decoder = (DigitDecoder*) arg;
+    size_t done = 0;
+    while (done < len && (decoder->out_pos < decoder->out_len || decoder->remaining > 0)) {
+        if (decoder->out_pos == decoder->out_len) {
+            // Refill: the padding of the last group is cut off by remaining
+            size_t per_group = digit_format_group_digits(decoder->format);
+            size_t groups = (decoder->remaining + per_group - 1) / per_group;
+            if (groups > DECODER_GROUPS) groups = DECODER_GROUPS;
+            if (fread(decoder->in, digit_format_group_bytes(decoder->format), groups, decoder->fp) != groups) break;
+            size_t decoded = digit_format_decode(decoder->format, decoder->in, groups, decoder->out);
+            decoder->out_len = decoded < decoder->remaining ? decoded : decoder->remaining;
+            decoder->out_pos = 0;
+            decoder->remaining -= decoder->out_len;
+        }
+        size_t n = decoder->out_len - decoder->out_pos;
+        if (n > len - done) n = len - done;
+        memcpy(buffer + done, decoder->out + decoder->out_pos, n);
+        decoder->out_pos += n;
+        done += n;
+    }
+    return done;
+}
+
+void digit_decoder_close(DigitDecoder* decoder) {
+    if (!decoder) return;
+    free(decoder->in);
+    free(decoder->out);
+    free(decoder);
+}
@@ -0,0 +1,453 @@
+// Asynchronous output backends for --io-engine.
+//
+// The output is copied into a ring of IO_ENGINE_DEPTH aligned buffers. A full buffer is
+// handed to the disk and filling goes on in the next one, so the conversion and formatting
+// of the following digits overlap the write of the previous ones; the producer only waits
+// when every buffer is still in flight. Buffers are written at increasing offsets with
+// O_DIRECT, bypassing the page cache: "direct" writes them with pwrite from a background
+// thread, "uring" queues them to an io_uring set up with raw system calls (no liburing).
+// The last buffer is padded to the alignment and the file truncated to its real size.
+// A file system without O_DIRECT support gets the same pipeline through the page cache.
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // O_DIRECT, syscall
+#endif
+
+#include "io_engine.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#define IO_ENGINE_DEPTH 4       // Buffers in the ring
+#define IO_ENGINE_ALIGN 4096    // Alignment of O_DIRECT buffers, lengths and offsets
+
+static const char* engine_names[] = {"stdio", "direct", "uring"};
+
+static IoEngine io_selected = IO_ENGINE_STDIO;
+static unsigned long long io_bytes = 0;     // Bytes of the files written by an engine
+static double io_seconds = 0;               // From their first queued write to closing them
+static double io_wait = 0;                  // Time the producer waited for a free buffer or the last writes
+static int io_files = 0;
+static bool io_page_cache = false;          // A file fell back to buffered writes
+
+// Parse an engine name
+int io_engine_parse(const char* name, IoEngine* engine) {
+    for (int i = 0; i < (int) (sizeof(engine_names) / sizeof(engine_names[0])); i++) {
+        if (strcmp(name, engine_names[i]) == 0) {
+            *engine = (IoEngine) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+bool io_engine_enabled(void) {
+    return io_selected != IO_ENGINE_STDIO;
+}
+
+#ifdef __linux__
+// Submission and completion rings shared with the kernel
+typedef struct {
+    int fd;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+} IoRing;
+
+struct IoWriter {
+    int fd;
+    IoEngine engine;
+    bool direct;                            // Opened with O_DIRECT
+    size_t buffer_size;                     // Multiple of IO_ENGINE_ALIGN
+    char* buffers[IO_ENGINE_DEPTH];
+    size_t lengths[IO_ENGINE_DEPTH];
+    unsigned long long offsets[IO_ENGINE_DEPTH];
+    size_t fill;                            // Bytes in the current buffer
+    unsigned long long submitted;           // Buffers handed to the disk; the current one is submitted % depth
+    unsigned long long completed;           // Buffers written (direct)
+    bool in_flight[IO_ENGINE_DEPTH];        // Buffers queued to the ring (uring)
+    unsigned long long offset;              // File offset of the current buffer
+    int error;                              // errno of the first failed write
+    double start;                           // First submission
+    double wait;                            // Time spent waiting for the disk
+
+    // direct: the writer thread
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // uring
+    IoRing ring;
+};
+
+// pwrite all of buffer, continuing after short writes
+static int write_all(int fd, const char* buffer, size_t size, unsigned long long offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, buffer, size, (off_t) offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        buffer += written;
+        size -= (size_t) written;
+        offset += (unsigned long long) written;
+    }
+    return 0;
+}
+
+// ---------------- io_uring ----------------
+
+static int ring_setup(IoRing* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -1;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap ? ring->sq_ring : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+        if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+        if (ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return -1;
+    }
+
+    char* sq = (char*) ring->sq_ring;
+    char* cq = (char*) ring->cq_ring;
+    ring->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned*) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ring_release(IoRing* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Queue the write of buffer slot
+static void ring_submit(IoWriter* writer, int slot) {
+    IoRing* ring = &writer->ring;
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = writer->fd;
+    sqe->addr = (uint64_t) (uintptr_t) writer->buffers[slot];
+    sqe->len = (uint32_t) writer->lengths[slot];
+    sqe->off = writer->offsets[slot];
+    sqe->user_data = (uint64_t) slot;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    writer->in_flight[slot] = true;
+
+    while (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno == EINTR) continue;
+        // Not queued: write it here instead
+        int error = write_all(writer->fd, writer->buffers[slot], writer->lengths[slot], writer->offsets[slot]);
+        if (error && !writer->error) writer->error = error;
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+        writer->in_flight[slot] = false;
+        return;
+    }
+}
+
+// Wait for at least one completion and retire all that are there
+static void ring_reap(IoWriter* writer) {
+    IoRing* ring = &writer->ring;
+    while (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno == EINTR) {
+    }
+
+    unsigned head = *ring->cq_head;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        int slot = (int) cqe->user_data;
+        if (cqe->res < 0) {
+            if (!writer->error) writer->error = -cqe->res;
+        } else if ((size_t) cqe->res < writer->lengths[slot]) {
+            // Short write: finish the rest synchronously
+            int error = write_all(writer->fd, writer->buffers[slot] + cqe->res, writer->lengths[slot] - (size_t) cqe->res,
+                writer->offsets[slot] + (unsigned long long) cqe->res);
+            if (error && !writer->error) writer->error = error;
+        }
+        writer->in_flight[slot] = false;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// ---------------- direct: writer thread ----------------
+
+// I/O thread: write the submitted buffers in order until stopped
+static void* io_writer_main(void* arg) {
+    IoWriter* writer = (IoWriter*) arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->completed == writer->submitted && !writer->stop) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (writer->completed == writer->submitted) break; // Stopped with nothing left to write
+
+        int slot = (int) (writer->completed % IO_ENGINE_DEPTH);
+        pthread_mutex_unlock(&writer->lock);
+
+        int error = write_all(writer->fd, writer->buffers[slot], writer->lengths[slot], writer->offsets[slot]);
+
+        pthread_mutex_lock(&writer->lock);
+        if (error && !writer->error) writer->error = error;
+        writer->completed++;
+        pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// ---------------- common ----------------
+
+// Wait until buffer slot may be filled again
+static void wait_slot(IoWriter* writer, int slot) {
+    double start = omp_get_wtime();
+    if (writer->engine == IO_ENGINE_URING) {
+        while (writer->in_flight[slot]) ring_reap(writer);
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->submitted - writer->completed >= IO_ENGINE_DEPTH) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        pthread_mutex_unlock(&writer->lock);
+    }
+    writer->wait += omp_get_wtime() - start;
+}
+
+// Hand the current buffer (length bytes, padded for O_DIRECT) to the disk
+static void submit_current(IoWriter* writer, size_t length) {
+    int slot = (int) (writer->submitted % IO_ENGINE_DEPTH);
+    writer->lengths[slot] = length;
+    writer->offsets[slot] = writer->offset;
+    writer->offset += length;
+    writer->fill = 0;
+    if (writer->submitted == 0) writer->start = omp_get_wtime();
+
+    if (writer->engine == IO_ENGINE_URING) {
+        writer->submitted++;
+        ring_submit(writer, slot);
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        writer->submitted++;
+        pthread_cond_signal(&writer->cond);
+        pthread_mutex_unlock(&writer->lock);
+    }
+}
+
+static void release(IoWriter* writer) {
+    for (int i = 0; i < IO_ENGINE_DEPTH; i++) free(writer->buffers[i]);
+    if (writer->fd >= 0) close(writer->fd);
+    free(writer);
+}
+#else
+struct IoWriter {
+    int unused;
+};
+#endif
+
+// Select the engine for result files
+int io_engine_select(IoEngine engine) {
+    if (engine == IO_ENGINE_STDIO) {
+        io_selected = engine;
+        return 0;
+    }
+    #ifdef __linux__
+    if (engine == IO_ENGINE_URING) {
+        // Kernels without io_uring, or containers that forbid it
+        IoRing ring;
+        if (ring_setup(&ring, IO_ENGINE_DEPTH) != 0) return -1;
+        ring_release(&ring);
+    }
+    io_selected = engine;
+    return 0;
+    #else
+    return -1;
+    #endif
+}
+
+// Create a result file for the selected engine
+IoWriter* io_writer_open(const char* filename, size_t buffer_size) {
+    #ifdef __linux__
+    if (io_selected == IO_ENGINE_STDIO) return NULL;
+
+    // Pipes and devices keep stdio; the file is only truncated once it is known to be regular
+    struct stat st;
+    if (stat(filename, &st) == 0 && !S_ISREG(st.st_mode)) return NULL;
+
+    IoWriter* writer = (IoWriter*) calloc(1, sizeof(IoWriter));
+    if (!writer) return NULL;
+    writer->engine = io_selected;
+    writer->direct = true;
+    writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (writer->fd < 0 && errno == EINVAL) {
+        // No O_DIRECT on this file system (tmpfs): same pipeline through the page cache
+        writer->direct = false;
+        io_page_cache = true;
+        writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (writer->fd < 0) {
+        free(writer);
+        return NULL;
+    }
+
+    writer->buffer_size = (buffer_size + IO_ENGINE_ALIGN - 1) / IO_ENGINE_ALIGN * IO_ENGINE_ALIGN;
+    for (int i = 0; i < IO_ENGINE_DEPTH; i++) {
+        void* buffer;
+        if (posix_memalign(&buffer, IO_ENGINE_ALIGN, writer->buffer_size) != 0) {
+            release(writer);
+            return NULL;
+        }
+        writer->buffers[i] = (char*) buffer;
+    }
+
+    int started;
+    if (writer->engine == IO_ENGINE_URING) {
+        started = ring_setup(&writer->ring, IO_ENGINE_DEPTH);
+    } else {
+        pthread_mutex_init(&writer->lock, NULL);
+        pthread_cond_init(&writer->cond, NULL);
+        started = pthread_create(&writer->thread, NULL, io_writer_main, writer);
+        if (started != 0) {
+            pthread_cond_destroy(&writer->cond);
+            pthread_mutex_destroy(&writer->lock);
+        }
+    }
+    if (started != 0) {
+        release(writer);
+        return NULL;
+    }
+
+    return writer;
+    #else
+    (void) filename; (void) buffer_size;
+    return NULL;
+    #endif
+}
+
+// Copy data into the ring, queueing full buffers
+void io_writer_write(IoWriter* writer, const void* data, size_t len) {
+    #ifdef __linux__
+    const char* bytes = (const char*) data;
+    while (len > 0) {
+        int slot = (int) (writer->submitted % IO_ENGINE_DEPTH);
+        if (writer->fill == 0) wait_slot(writer, slot);
+
+        size_t n = writer->buffer_size - writer->fill;
+        if (n > len) n = len;
+        memcpy(writer->buffers[slot] + writer->fill, bytes, n);
+        writer->fill += n;
+        bytes += n;
+        len -= n;
+        if (writer->fill == writer->buffer_size) submit_current(writer, writer->fill);
+    }
+    #else
+    (void) writer; (void) data; (void) len;
+    #endif
+}
+
+// Write the tail, drain the ring and close
+int io_writer_close(IoWriter* writer) {
+    #ifdef __linux__
+    unsigned long long size = writer->offset + writer->fill;
+    if (writer->fill > 0) {
+        size_t length = writer->fill;
+        if (writer->direct) {
+            // O_DIRECT writes whole blocks; the padding is cut off below
+            length = (length + IO_ENGINE_ALIGN - 1) / IO_ENGINE_ALIGN * IO_ENGINE_ALIGN;
+            memset(writer->buffers[writer->submitted % IO_ENGINE_DEPTH] + writer->fill, 0, length - writer->fill);
+        }
+        submit_current(writer, length);
+    }
+
+    double drain_start = omp_get_wtime();
+    if (writer->engine == IO_ENGINE_URING) {
+        for (int i = 0; i < IO_ENGINE_DEPTH; i++) {
+            while (writer->in_flight[i]) ring_reap(writer);
+        }
+        ring_release(&writer->ring);
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        writer->stop = true;
+        pthread_cond_signal(&writer->cond);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->lock);
+    }
+
+    writer->wait += omp_get_wtime() - drain_start;
+
+    int error = writer->error;
+    if (!error && writer->direct && writer->offset != size && ftruncate(writer->fd, (off_t) size) != 0) error = errno;
+    if (close(writer->fd) != 0 && !error) error = errno;
+    writer->fd = -1;
+
+    io_bytes += size;
+    if (writer->submitted > 0) io_seconds += omp_get_wtime() - writer->start;
+    io_wait += writer->wait;
+    io_files++;
+    release(writer);
+
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+    #else
+    (void) writer;
+    return -1;
+    #endif
+}
+
+// Print the bytes written by the engine and the throughput
+void io_engine_report(FILE* out) {
+    if (io_files == 0) return;
+    fprintf(out, "Output engine: %s%s, %llu bytes in %.2f seconds (%.1f MB/s), %.2f seconds waiting for the disk\n",
+        engine_names[io_selected], io_page_cache ? " (page cache, no O_DIRECT here)" : " (O_DIRECT)", io_bytes,
+        io_seconds, io_seconds > 0 ? (double) io_bytes / io_seconds / 1e6 : 0.0, io_wait);
+}
@@ -0,0 +1,149 @@
+// libpi: the calculator as a reentrant library (see libpi.h).
+//
+// The context owns the series constants and the settings. A computation passes the
+// constants down to calculate_pi_constants, which keeps all of its state on the stack
+// and in per-call allocations. The OpenMP team size and schedule it sets are per calling
+// thread (OpenMP keeps one thread pool per thread that opens parallel regions); they are
+// restored afterwards so the embedding thread sees no change.
+
+#include "libpi.h"
+#include "pi_internal.h"
+#include "radix.h"
+#include <math.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct PiContext {
+    int num_threads;
+    const char* algorithm;      // Static strings: "series" or "binsplit"
+    const char* schedule;
+    int chunk_size;
+    #ifdef ENABLE_BLOCK_FACTORIAL
+    unsigned long block_size;
+    #endif
+    PiConstants constants;
+};
+
+// Create a context computing with num_threads OpenMP threads
+PiContext* pi_context_create(int num_threads) {
+    PiContext* ctx = (PiContext*) calloc(1, sizeof(PiContext));
+    if (!ctx) return NULL;
+
+    ctx->num_threads = num_threads > 0 ? num_threads : omp_get_max_threads();
+    ctx->algorithm = "series";
+    ctx->schedule = "guided";
+    ctx->chunk_size = 1;
+    #ifdef ENABLE_BLOCK_FACTORIAL
+    ctx->block_size = 8;
+    #endif
+    init_constants(&ctx->constants);
+    return ctx;
+}
+
+// Release a context and its constants
+void pi_context_destroy(PiContext* ctx) {
+    if (!ctx) return;
+    clean_constants(&ctx->constants);
+    free(ctx);
+}
+
+PiStatus pi_context_set_algorithm(PiContext* ctx, const char* algorithm) {
+    if (!ctx || !algorithm) return PI_ERROR_INVALID_ARGUMENT;
+    if (strcmp(algorithm, "series") == 0) {
+        ctx->algorithm = "series";
+    } else if (strcmp(algorithm, "binsplit") == 0) {
+        ctx->algorithm = "binsplit";
+    } else {
+        return PI_ERROR_INVALID_ARGUMENT;
+    }
+    return PI_OK;
+}
+
+PiStatus pi_context_set_schedule(PiContext* ctx, const char* schedule, int chunk_size) {
+    static const char* schedules[] = {"static", "dynamic", "guided", "contiguous"};
+    if (!ctx || !schedule || chunk_size < 0) return PI_ERROR_INVALID_ARGUMENT;
+    for (size_t i = 0; i < sizeof(schedules) / sizeof(schedules[0]); i++) {
+        if (strcmp(schedule, schedules[i]) == 0) {
+            ctx->schedule = schedules[i];
+            ctx->chunk_size = chunk_size;
+            return PI_OK;
+        }
+    }
+    return PI_ERROR_INVALID_ARGUMENT;
+}
+
+// Compute pi to digits decimal digits into pi
+PiStatus pi_compute(PiContext* ctx, unsigned long digits, mpf_t pi) {
+    if (!ctx || digits == 0) return PI_ERROR_INVALID_ARGUMENT;
+
+    // calculate_pi sets the team size and schedule of the calling thread; put them back
+    int saved_threads = omp_get_max_threads();
+    omp_sched_t saved_schedule;
+    int saved_chunk_size;
+    omp_get_schedule(&saved_schedule, &saved_chunk_size);
+
+    #ifdef ENABLE_BLOCK_FACTORIAL
+    PiStatus status = calculate_pi_constants(&ctx->constants, pi, digits, ctx->algorithm, ctx->num_threads,
+        ctx->schedule, ctx->chunk_size, ctx->block_size, 0, false, 1, true, false, 1, NULL, false, NULL);
+    #else
+    PiStatus status = calculate_pi_constants(&ctx->constants, pi, digits, ctx->algorithm, ctx->num_threads,
+        ctx->schedule, ctx->chunk_size, 0, false, 1, true, false, 1, NULL, false, NULL);
+    #endif
+
+    omp_set_num_threads(saved_threads);
+    omp_set_schedule(saved_schedule, saved_chunk_size);
+    return status;
+}
+
+// Compute pi and return it as "3." followed by digits decimals
+PiStatus pi_compute_string(PiContext* ctx, unsigned long digits, char** str) {
+    if (!str) return PI_ERROR_INVALID_ARGUMENT;
+    *str = NULL;
+
+    mpf_t pi;
+    mpf_init2(pi, (mp_bitcnt_t) ((digits + 2) * log2(10)));
+    PiStatus status = pi_compute(ctx, digits, pi);
+    if (status != PI_OK) {
+        mpf_clear(pi);
+        return status;
+    }
+
+    // One guard digit, like the file output
+    mp_exp_t exp;
+    char* converted = radix_get_str(&exp, digits + 2, pi);
+    mpf_clear(pi);
+    if (!converted || exp != 1) {
+        free(converted);
+        return PI_ERROR_CONVERSION;
+    }
+
+    char* result = (char*) malloc(digits + 3);
+    if (!result) {
+        free(converted);
+        return PI_ERROR_OUT_OF_MEMORY;
+    }
+    result[0] = converted[0];
+    result[1] = '.';
+    memcpy(result + 2, converted + 1, digits);
+    result[digits + 2] = '\0';
+    free(converted);
+
+    *str = result;
+    return PI_OK;
+}
+
+void pi_free_string(char* str) {
+    free(str);
+}
+
+const char* pi_status_string(PiStatus status) {
+    switch (status) {
+        case PI_OK: return "success";
+        case PI_ERROR_INVALID_ARGUMENT: return "invalid argument";
+        case PI_ERROR_OUT_OF_MEMORY: return "out of memory";
+        case PI_ERROR_CONVERSION: return "decimal conversion failed";
+        case PI_ERROR_IO: return "swap file read failed";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,206 @@
+// NUMA placement of the series workers.
+//
+// The topology comes from /sys/devices/system/node/node<N>/cpulist, restricted to
+// the CPUs the process may run on. The usable CPUs are listed node by node and
+// worker t is pinned to CPU floor(t * cpus / threads), so every node gets a run of
+// consecutive worker IDs in proportion to its CPUs. Workers allocate their own
+// buffers after pinning, so the pages are first touched on the local node.
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // sched_setaffinity
+#endif
+
+#include "numa.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define NUMA_MAX_NODES 256
+
+static bool numa_active = false;
+static int numa_threads = 0;
+static int numa_nodes = 0;
+static int* thread_cpu = NULL;          // CPU of each worker
+static int* thread_node = NULL;         // Node of each worker
+static int* node_first = NULL;          // First worker of each node (numa_nodes + 1 entries)
+static int* node_id = NULL;             // sysfs number of each node
+static double* thread_compute = NULL;   // Compute time of each worker
+static double* node_reduction = NULL;   // Local reduction time of each node
+static double cross_node_time = 0;
+
+#ifdef __linux__
+// Add the CPUs of a sysfs cpulist ("0-3,8,10-11") that are also in allowed to cpus
+static int parse_cpulist(const char* list, const cpu_set_t* allowed, int* cpus, int count, int max_cpus) {
+    const char* p = list;
+    while (*p && *p != '\n') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && count < max_cpus; cpu++) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, allowed)) cpus[count++] = (int) cpu;
+        }
+        if (*p == ',') p++;
+    }
+    return count;
+}
+#endif
+
+// Read the NUMA topology and spread num_threads workers over the nodes
+int numa_setup(int num_threads) {
+    #ifdef __linux__
+    cpu_set_t allowed;
+    if (num_threads <= 0 || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+
+    int max_cpus = CPU_COUNT(&allowed);
+    int* cpus = (int*) malloc(max_cpus * sizeof(int));           // Usable CPUs, node by node
+    int* cpu_node_index = (int*) malloc(max_cpus * sizeof(int)); // Node index of each of them
+    node_id = (int*) malloc(NUMA_MAX_NODES * sizeof(int));
+    if (!cpus || !cpu_node_index || !node_id) {
+        free(cpus);
+        free(cpu_node_index);
+        return -1;
+    }
+
+    int count = 0;
+    numa_nodes = 0;
+    for (int n = 0; n < NUMA_MAX_NODES; n++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+        FILE* fp = fopen(path, "r");
+        if (!fp) continue;
+
+        char list[4096];
+        int before = count;
+        if (fgets(list, sizeof(list), fp)) {
+            count = parse_cpulist(list, &allowed, cpus, count, max_cpus);
+        }
+        fclose(fp);
+
+        // Nodes without usable CPUs get no workers
+        if (count == before) continue;
+        for (int i = before; i < count; i++) cpu_node_index[i] = numa_nodes;
+        node_id[numa_nodes++] = n;
+    }
+
+    if (count == 0) {
+        free(cpus);
+        free(cpu_node_index);
+        return -1;
+    }
+
+    thread_cpu = (int*) malloc(num_threads * sizeof(int));
+    thread_node = (int*) malloc(num_threads * sizeof(int));
+    node_first = (int*) malloc((numa_nodes + 1) * sizeof(int));
+    thread_compute = (double*) calloc(num_threads, sizeof(double));
+    node_reduction = (double*) calloc(numa_nodes, sizeof(double));
+    if (!thread_cpu || !thread_node || !node_first || !thread_compute || !node_reduction) {
+        free(cpus);
+        free(cpu_node_index);
+        return -1;
+    }
+
+    for (int t = 0; t < num_threads; t++) {
+        int index = (int) ((long long) t * count / num_threads);
+        thread_cpu[t] = cpus[index];
+        thread_node[t] = cpu_node_index[index];
+    }
+
+    // Workers of a node are consecutive. Nodes left without workers (fewer threads than nodes)
+    // are dropped, so every node of the reduction tree has a sum of its own
+    int t = 0, used = 0;
+    for (int n = 0; n < numa_nodes; n++) {
+        if (t == num_threads || thread_node[t] != n) continue;
+        node_first[used] = t;
+        node_id[used] = node_id[n];
+        while (t < num_threads && thread_node[t] == n) thread_node[t++] = used;
+        used++;
+    }
+    numa_nodes = used;
+    node_first[numa_nodes] = num_threads;
+
+    free(cpus);
+    free(cpu_node_index);
+    numa_threads = num_threads;
+    numa_active = true;
+    return 0;
+    #else
+    (void) num_threads;
+    return -1;
+    #endif
+}
+
+// Whether numa_setup succeeded
+bool numa_enabled(void) {
+    return numa_active;
+}
+
+// Pin the calling thread to the CPU of worker tid
+void numa_bind_thread(int tid) {
+    #ifdef __linux__
+    if (!numa_active || tid >= numa_threads) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(thread_cpu[tid], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+    #else
+    (void) tid;
+    #endif
+}
+
+int numa_thread_node(int tid) {
+    return tid < numa_threads ? thread_node[tid] : 0;
+}
+
+int numa_node_first(int node) {
+    return node_first[node];
+}
+
+int numa_node_count(void) {
+    return numa_nodes;
+}
+
+// Largest number of workers on one node
+int numa_max_node_threads(void) {
+    int max = 0;
+    for (int n = 0; n < numa_nodes; n++) {
+        if (node_first[n + 1] - node_first[n] > max) max = node_first[n + 1] - node_first[n];
+    }
+    return max;
+}
+
+void numa_add_compute_time(int tid, double seconds) {
+    if (tid < numa_threads) thread_compute[tid] += seconds;
+}
+
+void numa_add_reduction_time(int node, double seconds) {
+    node_reduction[node] += seconds;
+}
+
+void numa_add_cross_node_time(double seconds) {
+    cross_node_time += seconds;
+}
+
+// Print the threads, compute and reduction time of every node
+void numa_report(FILE* out) {
+    fprintf(out, "NUMA nodes:\n");
+    for (int n = 0; n < numa_nodes; n++) {
+        int first = node_first[n], last = node_first[n + 1];
+        double max = 0, sum = 0;
+        for (int t = first; t < last; t++) {
+            sum += thread_compute[t];
+            if (thread_compute[t] > max) max = thread_compute[t];
+        }
+        fprintf(out, "  Node %d: %d threads, compute %.2f s max / %.2f s avg, local reduction %.2f s\n",
+                node_id[n], last - first, max, last > first ? sum / (last - first) : 0, node_reduction[n]);
+    }
+    fprintf(out, "  Cross-node reduction: %.2f s\n", cross_node_time);
+}
@@ -0,0 +1,235 @@
+// Hardware performance counters per thread and phase, for --perf-counters.
+//
+// Every thread opens its own counter group with perf_event_open the first time it
+// begins a phase: cycles (leader), instructions, last-level cache misses and page
+// faults, counted in user space only. A phase is one read() of the group at its
+// start and one at its end; the difference is added to the thread's totals for that
+// phase. Counters the kernel or the machine does not provide (no PMU in a virtual
+// machine, perf_event_paranoid) are left out and reported as n/a.
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // syscall
+#endif
+
+#include "perf.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define PERF_COUNTERS 4
+
+#ifdef _MSC_VER
+#define PERF_THREAD_LOCAL __declspec(thread)
+#else
+#define PERF_THREAD_LOCAL _Thread_local
+#endif
+
+static const char* counter_names[PERF_COUNTERS] = {"cycles", "instructions", "llc_misses", "page_faults"};
+static const char* phase_names[PERF_PHASES] = {
+    "calculate_M", "calculate_X", "advance_M_X", "calculate_term", "reduction", "output"
+};
+
+// Counters and totals of one thread
+typedef struct PerfThread {
+    int fd[PERF_COUNTERS];              // -1 if the counter is not available
+    int slot[PERF_COUNTERS];            // Position of the counter in the group read
+    int group_size;
+    uint64_t start[PERF_COUNTERS];
+    uint64_t total[PERF_PHASES][PERF_COUNTERS];
+    unsigned long long calls[PERF_PHASES];
+    int id;                             // OpenMP thread number when registered
+    struct PerfThread* next;
+} PerfThread;
+
+static bool perf_active = false;
+static bool counter_available[PERF_COUNTERS];
+static PerfThread* perf_threads = NULL;     // All registered threads, newest first
+static PERF_THREAD_LOCAL PerfThread* perf_self = NULL;
+
+#ifdef __linux__
+// Open counter c for the calling thread in the group of group_fd (-1: new group)
+static int open_counter(int c, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (c) {
+        case 0: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case 1: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case 2: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        default:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+            break;
+    }
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group_fd == -1; // The leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+// Open the counter group of the calling thread: the first counter that opens leads it
+static void open_group(PerfThread* self) {
+    int leader = -1;
+    self->group_size = 0;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        self->fd[c] = open_counter(c, leader);
+        self->slot[c] = -1;
+        if (self->fd[c] < 0) continue;
+        if (leader == -1) leader = self->fd[c];
+        self->slot[c] = self->group_size++;
+    }
+    if (leader != -1) {
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+// Current values of the group, indexed by counter; false if it cannot be read
+static bool read_group(PerfThread* self, uint64_t* values) {
+    int leader = -1;
+    for (int c = 0; c < PERF_COUNTERS && leader == -1; c++) {
+        if (self->fd[c] >= 0) leader = self->fd[c];
+    }
+    if (leader == -1) return false;
+
+    uint64_t buffer[1 + PERF_COUNTERS];
+    ssize_t expected = (ssize_t) ((1 + self->group_size) * sizeof(uint64_t));
+    if (read(leader, buffer, sizeof(buffer)) < expected) return false;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        values[c] = self->slot[c] >= 0 ? buffer[1 + self->slot[c]] : 0;
+    }
+    return true;
+}
+#endif
+
+// State of the calling thread, registered and its counters opened on first use.
+// NULL if it cannot be allocated; the thread is then left uncounted
+static PerfThread* perf_thread(void) {
+    if (perf_self) return perf_self;
+
+    PerfThread* self = (PerfThread*) calloc(1, sizeof(PerfThread));
+    if (!self) return NULL;
+    #ifdef __linux__
+    open_group(self);
+    #else
+    for (int c = 0; c < PERF_COUNTERS; c++) self->fd[c] = -1;
+    #endif
+    self->id = omp_get_thread_num();
+
+    #pragma omp critical (perf_register)
+    {
+        self->next = perf_threads;
+        perf_threads = self;
+    }
+
+    perf_self = self;
+    return self;
+}
+
+// Probe which counters this machine allows
+int perf_enable(void) {
+    #ifdef __linux__
+    bool any = false;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        int fd = open_counter(c, -1);
+        counter_available[c] = fd >= 0;
+        if (fd >= 0) {
+            close(fd);
+            any = true;
+        }
+    }
+    if (!any) return -1;
+    perf_active = true;
+    return 0;
+    #else
+    return -1;
+    #endif
+}
+
+// Whether perf_enable succeeded
+bool perf_enabled(void) {
+    return perf_active;
+}
+
+void perf_phase_begin(void) {
+    #ifdef __linux__
+    if (!perf_active) return;
+    PerfThread* self = perf_thread();
+    if (!self) return;
+    if (!read_group(self, self->start)) memset(self->start, 0, sizeof(self->start));
+    #endif
+}
+
+void perf_phase_end(PerfPhase phase) {
+    #ifdef __linux__
+    if (!perf_active) return;
+    PerfThread* self = perf_thread();
+    if (!self) return;
+    uint64_t now[PERF_COUNTERS];
+    if (!read_group(self, now)) return;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        self->total[phase][c] += now[c] - self->start[c];
+    }
+    self->calls[phase]++;
+    #else
+    (void) phase;
+    #endif
+}
+
+// Print one row of counters
+static void print_counters(FILE* out, const char* label, const uint64_t* values, unsigned long long calls) {
+    fprintf(out, "  %-24s %12llu calls", label, calls);
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        if (counter_available[c]) {
+            fprintf(out, "  %s %15llu", counter_names[c], (unsigned long long) values[c]);
+        } else {
+            fprintf(out, "  %s %15s", counter_names[c], "n/a");
+        }
+    }
+    if (counter_available[0] && counter_available[1] && values[0] > 0) {
+        fprintf(out, "  IPC %.2f", (double) values[1] / values[0]);
+    }
+    if (counter_available[1] && counter_available[2] && values[1] > 0) {
+        fprintf(out, "  LLC MPKI %.3f", 1000.0 * values[2] / values[1]);
+    }
+    fprintf(out, "\n");
+}
+
+// Print the counters of every phase, in total and per thread
+void perf_report(FILE* out) {
+    fprintf(out, "Performance counters (user space):\n");
+    for (int p = 0; p < PERF_PHASES; p++) {
+        uint64_t sum[PERF_COUNTERS] = {0};
+        unsigned long long calls = 0;
+        for (PerfThread* t = perf_threads; t; t = t->next) {
+            for (int c = 0; c < PERF_COUNTERS; c++) sum[c] += t->total[p][c];
+            calls += t->calls[p];
+        }
+        if (calls == 0) continue;
+        print_counters(out, phase_names[p], sum, calls);
+
+        // Per thread, in OpenMP thread order
+        int max_id = 0;
+        for (PerfThread* t = perf_threads; t; t = t->next) {
+            if (t->id > max_id) max_id = t->id;
+        }
+        for (int id = 0; id <= max_id; id++) {
+            for (PerfThread* t = perf_threads; t; t = t->next) {
+                if (t->id != id || t->calls[p] == 0) continue;
+                char label[32];
+                snprintf(label, sizeof(label), "  thread %d", id);
+                print_counters(out, label, t->total[p], t->calls[p]);
+            }
+        }
+    }
+}
@@ -1,55 +1,65 @@
 #include "pi.h"
+#include "pi_internal.h"
 #include "checkpoint.h"
+#include "digit_cache.h"
+#include "binsplit.h"
+#include "radix.h"
+#include "text_layout.h"
+#include "io_engine.h"
+#include "swap.h"
+#include "numa.h"
+#include "stats.h"
+#include "perf.h"
+#include "trace.h"
 #include <gmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
 #include <string.h>
 
-#ifdef DEBUG
-unsigned long cache_hit_count = 0; // Count cache hits
-#endif
-
-static mpz_t CONST_X_BASE;  // CONST_X_BASE = -262537412640768000
-static mpz_t CONST_L_K;     // CONST_L_K = 545140134
-static mpz_t CONST_L_ADD;   // CONST_L_ADD = 13591409
-
-// Type definition for thread private variables
-typedef struct {
-    mpf_t S, term, temp_f;
-    mpz_t temp, M, L, X, K, k_fact, three_k_fact, six_k_fact;
-    #ifdef ENABLE_BLOCK_FACTORIAL
-    // Block factorial variables
-    mpz_t block_prod; // Block product for block factorial
-    unsigned long block_size; // Block size for block factorial
-    #endif
-} ThreadVariables;
+// Run call, attributing the hardware counters of the calling thread to phase (--perf-counters)
+#define PERF_PHASE(phase, call) do { \
+    if (perf_enabled()) { perf_phase_begin(); call; perf_phase_end(phase); } else { call; } \
+} while (0)
 
-#ifdef ENABLE_CACHE
-// Cache for factorials and powers
-typedef struct {
-    unsigned long k_M, K_X;
-    mpz_t k_fact, three_k_fact, six_k_fact, X;
-} ThreadCache;
-#endif
+// Initialize constants (before the workers that share them are created)
+void init_constants(PiConstants* constants) {
+    mpz_init_set_str(constants->x_base, "-262537412640768000", 10);
+    mpz_init_set_ui(constants->l_k, 545140134);
+    mpz_init_set_ui(constants->l_add, 13591409);
+}
 
-// Initialize constants (executed before entering the parallel region for the first time)
-static void init_constants() {
-    mpz_init_set_str(CONST_X_BASE, "-262537412640768000", 10);
-    mpz_init_set_ui(CONST_L_K, 545140134);
-    mpz_init_set_ui(CONST_L_ADD, 13591409);
+// Clean up constants (after the last worker is done with them)
+void clean_constants(PiConstants* constants) {
+    mpz_clears(constants->x_base, constants->l_k, constants->l_add, NULL);
 }
 
-// Clean up constants (executed after exiting the parallel region)
-static void clean_constants() {
-    mpz_clears(CONST_X_BASE, CONST_L_K, CONST_L_ADD, NULL);
+// log2(n!)
+static double log2_factorial(unsigned long n) {
+    return lgamma((double) n + 1) / log(2.0);
 }
 
-// Initialize thread variables
-void init_thread_variables(ThreadVariables* var) {
-    mpf_init_set_ui(var->S, 0);
-    mpf_inits(var->term, var->temp_f, NULL);
-    mpz_inits(var->temp, var->M, var->L, var->X, var->K, var->k_fact, var->three_k_fact, var->six_k_fact, NULL);
+// Initialize thread variables, sized for the terms up to max_k so they never grow
+void init_thread_variables(ThreadVariables* var, unsigned long max_k, mp_bitcnt_t prec,
+    const PiConstants* constants) {
+    mp_bitcnt_t six_k_bits = (mp_bitcnt_t) log2_factorial(6 * max_k) + 64;
+    mp_bitcnt_t three_k_bits = (mp_bitcnt_t) log2_factorial(3 * max_k) + 64;
+    mp_bitcnt_t k_bits = (mp_bitcnt_t) log2_factorial(max_k) + 64;
+
+    var->constants = constants;
+    #ifdef DEBUG
+    var->cache_hits = 0;
+    #endif
+    mpf_init2(var->S, prec);
+    mpf_init2(var->term, prec);
+    mpf_init2(var->temp_f, prec);
+    mpz_inits(var->L, var->K, NULL);
+    mpz_init2(var->temp, six_k_bits);       // Holds (3k)! * (k!)^3 <= (6k)!
+    mpz_init2(var->M, six_k_bits - three_k_bits - 3 * k_bits + 256);
+    mpz_init2(var->X, (mp_bitcnt_t) (max_k * log2(262537412640768000.0)) + 64);
+    mpz_init2(var->k_fact, k_bits);
+    mpz_init2(var->three_k_fact, three_k_bits);
+    mpz_init2(var->six_k_fact, six_k_bits);
     #ifdef ENABLE_BLOCK_FACTORIAL
     mpz_init(var->block_prod); // Initialize block product
     #endif
@@ -62,14 +72,67 @@ void clean_thread_variables(ThreadVariables* var) {
     #ifdef ENABLE_BLOCK_FACTORIAL
     mpz_clear(var->block_prod); // Clean up block product
     #endif
+    #ifdef ENABLE_PRECISION_TAPER
+    for (int b = 0; b < PRECISION_TAPER_BANDS; b++) {
+        mpf_clear(var->band_S[b]); // Clean up band sums
+    }
+    #endif
+}
+
+// Start a new block: the sums go back to zero, everything else is kept
+void reset_thread_sums(ThreadVariables* var) {
+    mpf_set_ui(var->S, 0);
+    #ifdef ENABLE_PRECISION_TAPER
+    for (int b = 0; b < PRECISION_TAPER_BANDS; b++) {
+        mpf_set_ui(var->band_S[b], 0);
+    }
+    #endif
 }
 
+#ifdef ENABLE_PRECISION_TAPER
+// Precision term k needs: it is about 2^(-47.11k) of the sum, so its low bits are below the sum's precision
+static mp_bitcnt_t term_precision(unsigned long k, mp_bitcnt_t full_prec) {
+    double drop = (double) k * TERM_BITS_PER_K;
+    if (drop >= (double) full_prec) return PRECISION_GUARD_BITS;
+    return full_prec - (mp_bitcnt_t) drop + PRECISION_GUARD_BITS;
+}
+
+// Initialize the band sums: band b holds the terms [b * band_terms, (b + 1) * band_terms)
+// at the precision of its first term
+void init_precision_bands(ThreadVariables* var, unsigned long iterations) {
+    var->full_prec = mpf_get_prec(var->term);
+    var->band_terms = iterations / PRECISION_TAPER_BANDS + 1;
+    for (int b = 0; b < PRECISION_TAPER_BANDS; b++) {
+        mp_bitcnt_t prec = term_precision(b * var->band_terms, var->full_prec);
+        mpf_init2(var->band_S[b], prec < var->full_prec ? prec : var->full_prec);
+    }
+}
+
+// Add the term k to the sum of its band
+void accumulate_term(unsigned long k, ThreadVariables* var) {
+    mpf_t* band = &var->band_S[k / var->band_terms];
+    mpf_add(*band, *band, var->term);
+}
+
+// Add the band sums to S, smallest first, and give term and temp_f back their full precision
+void merge_precision_bands(ThreadVariables* var) {
+    for (int b = PRECISION_TAPER_BANDS - 1; b >= 0; b--) {
+        mpf_add(var->S, var->S, var->band_S[b]);
+    }
+    mpf_set_prec_raw(var->term, var->full_prec);
+    mpf_set_prec_raw(var->temp_f, var->full_prec);
+}
+#endif
+
 #ifdef ENABLE_CACHE
-// Initialize thread cache
-void init_thread_cache(ThreadCache* cache) {
+// Initialize thread cache, sized for the terms up to max_k
+void init_thread_cache(ThreadCache* cache, unsigned long max_k) {
     cache->k_M = 0;
     cache->K_X = 0;
-    mpz_inits(cache->k_fact, cache->three_k_fact, cache->six_k_fact, cache->X, NULL);
+    mpz_init2(cache->k_fact, (mp_bitcnt_t) log2_factorial(max_k) + 64);
+    mpz_init2(cache->three_k_fact, (mp_bitcnt_t) log2_factorial(3 * max_k) + 64);
+    mpz_init2(cache->six_k_fact, (mp_bitcnt_t) log2_factorial(6 * max_k) + 64);
+    mpz_init2(cache->X, (mp_bitcnt_t) (max_k * log2(262537412640768000.0)) + 64);
     mpz_set_ui(cache->k_fact, 1);         // k = 0 -> k! = 1
     mpz_set_ui(cache->three_k_fact, 1);   // k = 0 -> (3k)! = 1
     mpz_set_ui(cache->six_k_fact, 1);     // k = 0 -> (6k)! = 1
@@ -158,8 +221,7 @@ void calculate_M(unsigned long k, ThreadVariables* var) {
         #endif
 
         #ifdef DEBUG
-        #pragma omp atomic
-        ++cache_hit_count;
+        ++var->cache_hits;
         #endif
     #endif
     } else {
@@ -174,10 +236,30 @@ void calculate_M(unsigned long k, ThreadVariables* var) {
     mpz_divexact(var->M, var->six_k_fact, var->temp);
 }
 
+// Advance M and X from k-1 to k by their exact ratios (contiguous schedule):
+// M(k) = M(k-1) * 24 (6k-5)(2k-1)(6k-1) / k^3, X(k) = X(k-1) * (-262537412640768000)
+void advance_M_X(unsigned long k, ThreadVariables* var) {
+    mpz_mul_ui(var->M, var->M, 24);
+    mpz_mul_ui(var->M, var->M, 6 * k - 5);
+    mpz_mul_ui(var->M, var->M, 2 * k - 1);
+    mpz_mul_ui(var->M, var->M, 6 * k - 1);
+
+    // The product is divisible by k^3, so each division by k is exact
+    mpz_divexact_ui(var->M, var->M, k);
+    mpz_divexact_ui(var->M, var->M, k);
+    mpz_divexact_ui(var->M, var->M, k);
+
+    mpz_mul(var->X, var->X, var->constants->x_base);
+
+    #ifdef DEBUG
+    var->cache_hits += 2;
+    #endif
+}
+
 // Calculate L = 545140134k + 13591409
 void calculate_L(unsigned long k, ThreadVariables* var) {
-    mpz_mul_ui(var->temp, CONST_L_K, k);
-    mpz_add(var->L, var->temp, CONST_L_ADD);
+    mpz_mul_ui(var->temp, var->constants->l_k, k);
+    mpz_add(var->L, var->temp, var->constants->l_add);
 }
 
 // Calculate X = (-262537412640768000)^k
@@ -194,20 +276,29 @@ void calculate_X(unsigned long k, ThreadVariables* var) {
     } else if (k - 1 == cache->K_X) {
         // Recursive calculation power
         // (-262537412640768000)^k = (-262537412640768000)^(k-1)*(-262537412640768000)
-        mpz_mul(var->X, cache->X, CONST_X_BASE);
+        mpz_mul(var->X, cache->X, var->constants->x_base);
         #ifdef DEBUG
-        #pragma omp atomic
-        ++cache_hit_count;
+        ++var->cache_hits;
         #endif
     #endif
     } else {
         // Calculate power
-        mpz_pow_ui(var->X, CONST_X_BASE, k);
+        mpz_pow_ui(var->X, var->constants->x_base, k);
     }
 }
 
 // Calculate the current item: term = M * L / X
 void calculate_term(unsigned long k, ThreadVariables* var) {
+    #ifdef ENABLE_PRECISION_TAPER
+    // Only as many bits as the term contributes to the sum
+    mp_bitcnt_t prec = term_precision(k, var->full_prec);
+    if (prec > var->full_prec) prec = var->full_prec;
+    mpf_set_prec_raw(var->term, prec);
+    mpf_set_prec_raw(var->temp_f, prec);
+    #else
+    (void) k;
+    #endif
+
     mpf_set_z(var->term, var->M);
     mpf_set_z(var->temp_f, var->L);
     mpf_mul(var->term, var->term, var->temp_f);
@@ -215,29 +306,238 @@ void calculate_term(unsigned long k, ThreadVariables* var) {
     mpf_div(var->term, var->term, var->temp_f);
 }
 
+// Count a finished term and print the progress from the main thread
+static void report_progress(int tid, unsigned long long* completed_count, unsigned long iterations,
+    int progress_freq) {
+    unsigned long long completed;
+    #pragma omp atomic capture
+    completed = ++(*completed_count);
+
+    if (completed % progress_freq == 0 && tid == 0) {
+        // Use the thread ID to determine execution on the main thread
+        fprintf(stderr, "\rProgress: %.2f%%", (double) completed / iterations * 100);
+        fflush(stderr);
+    }
+}
+
+// Add the segments of all threads into thread_S[0] in log2(num_threads) rounds; called by every
+// thread of the parallel region. In round r, thread i (a multiple of 2^(r+1)) adds slot i + 2^r
+static void reduce_thread_sums(mpf_t* thread_S, int tid, int num_threads) {
+    for (int stride = 1; stride < num_threads; stride *= 2) {
+        if (tid % (2 * stride) == 0 && tid + stride < num_threads) {
+            mpf_add(thread_S[tid], thread_S[tid], thread_S[tid + stride]);
+        }
+        #pragma omp barrier
+    }
+}
+
+// NUMA mode: the segments of each node are reduced on the node first, then one sum per node
+// crosses the interconnect, pairwise between the first workers of the nodes
+static void reduce_thread_sums_numa(mpf_t* thread_S, int tid, int num_threads) {
+    int node = numa_thread_node(tid);
+    int first = numa_node_first(node);
+    int last = numa_node_first(node + 1) < num_threads ? numa_node_first(node + 1) : num_threads;
+
+    double start = omp_get_wtime();
+    for (int stride = 1; stride < numa_max_node_threads(); stride *= 2) {
+        if ((tid - first) % (2 * stride) == 0 && tid + stride < last) {
+            mpf_add(thread_S[tid], thread_S[tid], thread_S[tid + stride]);
+        }
+        #pragma omp barrier
+    }
+    if (tid == first) numa_add_reduction_time(node, omp_get_wtime() - start);
+
+    start = omp_get_wtime();
+    int nodes = numa_node_count();
+    for (int stride = 1; stride < nodes; stride *= 2) {
+        if (tid == first && node % (2 * stride) == 0 && node + stride < nodes) {
+            int other = numa_node_first(node + stride);
+            if (other < num_threads) mpf_add(thread_S[tid], thread_S[tid], thread_S[other]);
+        }
+        #pragma omp barrier
+    }
+    if (tid == 0) numa_add_cross_node_time(omp_get_wtime() - start);
+}
+
+// Save the checkpoint at the end of a block: handed to the background writer if there is one
+static void save_block_checkpoint(CheckpointWriter* writer, const char *checkpoint_file, unsigned long current_k,
+    const mpf_t global_S, unsigned long digits, int num_threads, uint32_t flags, bool quiet_flag, bool checkpoint_verbose) {
+    if (writer) {
+        checkpoint_writer_submit(writer, current_k, global_S);
+        return;
+    }
+
+    double start = trace_enabled() ? omp_get_wtime() : 0;
+    int ret = save_checkpoint(checkpoint_file, current_k, global_S, digits, (uint32_t) num_threads, flags, quiet_flag);
+    if (trace_enabled()) trace_span("checkpoint write", start, omp_get_wtime(), 0, current_k);
+
+    if (ret != 0) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Failed to save checkpoint\n");
+    } else if (checkpoint_verbose && !quiet_flag) {
+        fprintf(stderr, "\nCheckpoint saved at iteration %lu\n", current_k);
+    }
+}
+
+// Report how a checkpoint recovery went (ret as returned by the load functions)
+static void report_recovery(int ret, unsigned long start_k, unsigned long iterations, uint32_t saved_threads,
+    int num_threads, uint32_t saved_flags, uint32_t current_flags, bool quiet_flag) {
+    if (ret == 0) {
+        if (!quiet_flag) {
+            printf("Resuming from iteration %lu (%.2f%%)\n",
+                   start_k, (double) start_k / iterations * 100);
+        }
+        // Optional warning: Thread count or compilation options do not match
+        if (saved_threads != (uint32_t) num_threads && !quiet_flag) {
+            fprintf(
+                stderr,
+                "Warning: thread count mismatch (saved=%u, current=%d). Performance may be degraded due to load imbalance and cache inefficiency.\n",
+                saved_threads, num_threads);
+        }
+
+        if (saved_flags != current_flags && !quiet_flag) {
+            fprintf(
+                stderr,
+                "Warning: compilation flags mismatch (saved=0x%x, current=0x%x). Performance may be affected.\n",
+                saved_flags, current_flags);
+        }
+    } else if (ret == -1) {
+        if (!quiet_flag) printf("No checkpoint found, starting from 0.\n");
+    } else {
+        if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint file invalid, starting from 0.\n");
+    }
+}
+
+// Reload the finished subtrees listed in the manifest. A subtree whose node file is missing or
+// damaged ends the recovery there; the subtrees before it are kept and the node files from it on
+// are deleted, since the manifest saved next will no longer list them
+static int load_tree_checkpoint(const char *checkpoint_file, BinsplitStack* stack, unsigned long digits,
+    uint32_t* saved_threads, uint32_t* saved_flags, bool quiet_flag) {
+    unsigned long ends[CHECKPOINT_MAX_NODES];
+    int count = 0;
+    int ret = load_checkpoint_manifest(checkpoint_file, ends, &count, CHECKPOINT_MAX_NODES, digits,
+                                       saved_threads, saved_flags, quiet_flag);
+    if (ret != 0) return ret;
+
+    int i;
+    for (i = 0; i < count; i++) {
+        unsigned long start = binsplit_stack_end(stack);
+        if (ends[i] <= start) break;
+
+        BinsplitNode node;
+        binsplit_node_init(&node);
+        if (load_checkpoint_node(checkpoint_file, start, ends[i], node.P, node.Q, node.T, digits, quiet_flag) != 0) {
+            if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint node [%lu, %lu) unusable, recomputing from %lu\n",
+                                     start, ends[i], start);
+            binsplit_node_clear(&node);
+            break;
+        }
+        binsplit_stack_push(stack, ends[i], &node);
+        binsplit_node_clear(&node);
+    }
+    for (int j = i; j < count; j++) {
+        remove_checkpoint_node(checkpoint_file, j > 0 ? ends[j - 1] : 0, ends[j]);
+    }
+    return 0;
+}
+
+// Save the subtrees finished since the last checkpoint, then the manifest, then drop the node
+// files of subtrees that have been merged into larger ones
+static void save_tree_checkpoint(const char *checkpoint_file, const BinsplitStack* stack,
+    unsigned long* saved_ends, int* saved_count, unsigned long digits, int num_threads, uint32_t flags,
+    bool quiet_flag, bool checkpoint_verbose) {
+    int written = 0;
+    for (int i = 0; i < stack->count; i++) {
+        unsigned long start = i > 0 ? stack->end[i - 1] : 0;
+        bool on_disk = false;
+        for (int j = 0; j < *saved_count; j++) {
+            unsigned long saved_start = j > 0 ? saved_ends[j - 1] : 0;
+            if (saved_start == start && saved_ends[j] == stack->end[i]) on_disk = true;
+        }
+        if (on_disk) continue;
+
+        const BinsplitNode* node = &stack->node[i];
+        if (save_checkpoint_node(checkpoint_file, start, stack->end[i], node->P, node->Q, node->T,
+                                 digits, quiet_flag) != 0) {
+            if (!quiet_flag) fprintf(stderr, "Warning: Failed to save checkpoint\n");
+            return;
+        }
+        written++;
+    }
+
+    if (save_checkpoint_manifest(checkpoint_file, stack->end, stack->count, digits,
+                                 (uint32_t) num_threads, flags, quiet_flag) != 0) {
+        if (!quiet_flag) fprintf(stderr, "Warning: Failed to save checkpoint\n");
+        return;
+    }
+
+    for (int j = 0; j < *saved_count; j++) {
+        unsigned long saved_start = j > 0 ? saved_ends[j - 1] : 0;
+        bool listed = false;
+        for (int i = 0; i < stack->count; i++) {
+            unsigned long start = i > 0 ? stack->end[i - 1] : 0;
+            if (saved_start == start && saved_ends[j] == stack->end[i]) listed = true;
+        }
+        if (!listed) remove_checkpoint_node(checkpoint_file, saved_start, saved_ends[j]);
+    }
+    memcpy(saved_ends, stack->end, sizeof(unsigned long) * stack->count);
+    *saved_count = stack->count;
+
+    if (checkpoint_verbose && !quiet_flag) {
+        fprintf(stderr, "\nCheckpoint saved at iteration %lu (%d new node%s)\n",
+                binsplit_stack_end(stack), written, written == 1 ? "" : "s");
+    }
+}
+
 // Chudnovsky algorithm calculates PI
-void calculate_pi(mpf_t pi, unsigned long digits, int num_threads, const char *omp_schedule,
-    int chunk_size VAR_BLOCK_SIZE, bool show_progress, int progress_freq, bool quiet_flag,
-    bool enable_checkpoint, unsigned long checkpoint_freq, const char *checkpoint_file, bool checkpoint_verbose) {
+PiStatus calculate_pi(mpf_t pi, unsigned long digits, const char *algorithm, int num_threads, const char *omp_schedule,
+    int chunk_size VAR_BLOCK_SIZE, unsigned long leaf_size, bool show_progress, int progress_freq, bool quiet_flag,
+    bool enable_checkpoint, unsigned long checkpoint_freq, const char *checkpoint_file, bool checkpoint_verbose,
+    double* reduction_time) {
+    PiConstants constants;
+    init_constants(&constants);
+    #ifdef ENABLE_BLOCK_FACTORIAL
+    PiStatus status = calculate_pi_constants(&constants, pi, digits, algorithm, num_threads, omp_schedule, chunk_size,
+        block_size, leaf_size, show_progress, progress_freq, quiet_flag, enable_checkpoint, checkpoint_freq,
+        checkpoint_file, checkpoint_verbose, reduction_time);
+    #else
+    PiStatus status = calculate_pi_constants(&constants, pi, digits, algorithm, num_threads, omp_schedule, chunk_size,
+        leaf_size, show_progress, progress_freq, quiet_flag, enable_checkpoint, checkpoint_freq,
+        checkpoint_file, checkpoint_verbose, reduction_time);
+    #endif
+    clean_constants(&constants);
+    return status;
+}
+
+// calculate_pi with the constants supplied by the caller. Nothing here touches process-wide
+// GMP or OpenMP state other than the calling thread's team size and schedule, so independent
+// calls can run concurrently from different threads
+PiStatus calculate_pi_constants(const PiConstants* constants, mpf_t pi, unsigned long digits, const char *algorithm,
+    int num_threads, const char *omp_schedule, int chunk_size VAR_BLOCK_SIZE, unsigned long leaf_size,
+    bool show_progress, int progress_freq, bool quiet_flag, bool enable_checkpoint, unsigned long checkpoint_freq,
+    const char *checkpoint_file, bool checkpoint_verbose, double* reduction_time) {
     /* completed_count Used solely for progress display;
      * Does not increment if progress is disabled, avoiding atomic operation overhead */
     unsigned long long completed_count = 0;
+    double setup_start = omp_get_wtime();
 
     // Thread Count Legitimacy Verification
     if (num_threads <= 0) {
-        fprintf(stderr, "Warning: invalid thread count (%d), using 1 thread.\n", num_threads);
+        if (!quiet_flag) fprintf(stderr, "Warning: invalid thread count (%d), using 1 thread.\n", num_threads);
         num_threads = 1;
     }
+    if (reduction_time) *reduction_time = 0;
 
-    // Set sufficient precision
-    mpf_set_default_prec((digits + 2) * log2(10));
+    // Sufficient precision (explicit rather than the process-wide GMP default)
+    mp_bitcnt_t prec = (mp_bitcnt_t) ((digits + 2) * log2(10));
+    mpf_set_prec(pi, prec);
 
     // Original S changed to global_S
     mpf_t C, global_S, temp;
 
     // Initialize variable
-    mpf_inits(C, temp, NULL);
-    mpf_init_set_ui(global_S, 0);
+    mpf_init2(C, prec);
+    mpf_init2(temp, prec);
+    mpf_init2(global_S, prec);
 
     // Constant C = 426880 * sqrt(10005)
     mpf_set_ui(C, 426880);
@@ -247,10 +547,14 @@ void calculate_pi(mpf_t pi, unsigned long digits, int num_threads, const char *o
     // Calculate the required number of iterations (empirical formula)
     unsigned long iterations = (digits / 14) + 1;
 
+    stats_add_time(STATS_SETUP, omp_get_wtime() - setup_start);
+
     // ------------------ Checkpoint code begins ---------------------
     // Checkpoint Recovery
     unsigned long start_k = 0;
     uint32_t saved_threads = 0, saved_flags = 0, current_flags = 0;
+    CheckpointWriter* checkpoint_writer = NULL;
+    bool binsplit = strcmp(algorithm, "binsplit") == 0;
 
     if (enable_checkpoint) {
         if (checkpoint_freq < 100 && !quiet_flag) {
@@ -267,34 +571,26 @@ void calculate_pi(mpf_t pi, unsigned long digits, int num_threads, const char *o
         #ifdef ENABLE_BLOCK_FACTORIAL
         current_flags |= CHECKPOINT_FLAG_BLOCK_FACTORIAL;
         #endif
+        #ifdef ENABLE_PRECISION_TAPER
+        current_flags |= CHECKPOINT_FLAG_PRECISION_TAPER;
+        #endif
 
-        int ret = load_checkpoint(checkpoint_file, &start_k, global_S, digits,
-                                  &saved_threads, &saved_flags, quiet_flag);
-        if (ret == 0) {
-            if (!quiet_flag) {
-                printf("Resuming from iteration %lu (%.2f%%)\n",
-                       start_k, (double) start_k / iterations * 100);
-            }
-            // Optional warning: Thread count or compilation options do not match
-            if (saved_threads != (uint32_t) num_threads && !quiet_flag) {
-                fprintf(
-                    stderr,
-                    "Warning: thread count mismatch (saved=%u, current=%d). Performance may be degraded due to load imbalance and cache inefficiency.\n",
-                    saved_threads, num_threads);
+        // The binary splitting branch below reloads its finished subtrees itself
+        if (!binsplit) {
+            double load_start = omp_get_wtime();
+            int ret = load_checkpoint(checkpoint_file, &start_k, global_S, digits,
+                                      &saved_threads, &saved_flags, quiet_flag);
+            stats_add_time(STATS_CHECKPOINT_LOAD, omp_get_wtime() - load_start);
+            if (ret != 0) {
+                start_k = 0;
+                mpf_set_ui(global_S, 0);
             }
+            report_recovery(ret, start_k, iterations, saved_threads, num_threads,
+                            saved_flags, current_flags, quiet_flag);
 
-            if (saved_flags != current_flags && !quiet_flag) {
-                fprintf(
-                    stderr,
-                    "Warning: compilation flags mismatch (saved=0x%x, current=0x%x). Performance may be affected.\n",
-                    saved_flags, current_flags);
-            }
-        } else if (ret == -1) {
-            if (!quiet_flag) printf("No checkpoint found, starting from 0.\n");
-        } else {
-            if (!quiet_flag) fprintf(stderr, "Warning: Checkpoint file invalid, starting from 0.\n");
-            start_k = 0;
-            mpf_set_ui(global_S, 0);
+            // Checkpoints are written by an I/O thread while the next block is computed
+            checkpoint_writer = checkpoint_writer_create(checkpoint_file, digits, (uint32_t) num_threads,
+                                                         current_flags, quiet_flag, checkpoint_verbose);
         }
     }
     // ------------------ Checkpoint code ends   ---------------------
@@ -335,21 +631,144 @@ void calculate_pi(mpf_t pi, unsigned long digits, int num_threads, const char *o
     printf("OpenMP schedule type: %s, chunk size: %d\n", debug_schedule_name, debug_chunk_size);
     #endif
 
-    // Initialize global constants
-    init_constants();
+    // ------------------ Binary splitting begins ---------------------
+    if (binsplit) {
+        BinsplitContext ctx = { show_progress, progress_freq, iterations, 0,
+                                leaf_size ? leaf_size : binsplit_default_leaf_size(iterations, num_threads), 0,
+                                quiet_flag };
+        if (swap_enabled()) {
+            ctx.swap_threshold = iterations >> BINSPLIT_SWAP_LEVELS;
+            if (ctx.swap_threshold < 2) ctx.swap_threshold = 2;
+        }
+
+        int ret = 0;
+        if (!enable_checkpoint) {
+            // One tree over the whole series and a single final division
+            ret = binsplit_pi(pi, C, iterations, &ctx);
+        } else {
+            // Finished subtrees are kept on a stack and each one is saved once
+            BinsplitStack stack;
+            binsplit_stack_init(&stack);
+            double load_start = omp_get_wtime();
+            ret = load_tree_checkpoint(checkpoint_file, &stack, digits, &saved_threads, &saved_flags, quiet_flag);
+            stats_add_time(STATS_CHECKPOINT_LOAD, omp_get_wtime() - load_start);
+            start_k = binsplit_stack_end(&stack);
+            report_recovery(ret, start_k, iterations, saved_threads, num_threads,
+                            saved_flags, current_flags, quiet_flag);
+
+            // Ends of the subtrees the manifest on disk lists
+            unsigned long saved_ends[BINSPLIT_STACK_SIZE];
+            int saved_count = stack.count;
+            memcpy(saved_ends, stack.end, sizeof(unsigned long) * stack.count);
+
+            ctx.completed = start_k;
+            unsigned long current_k = start_k;
+            ret = 0;
+            while (current_k < iterations) {
+                unsigned long block_end = current_k + checkpoint_freq;
+                if (block_end > iterations) block_end = iterations;
+
+                BinsplitNode node;
+                binsplit_node_init(&node);
+                double series_start = omp_get_wtime();
+
+                #pragma omp parallel default(none) shared(node, current_k, block_end, ctx, ret)
+                #pragma omp single
+                ret = binsplit_compute(current_k, block_end, &node, true, &ctx);
+
+                if (ret != 0) {
+                    binsplit_node_clear(&node);
+                    break;
+                }
+                binsplit_stack_push(&stack, block_end, &node);
+                binsplit_node_clear(&node);
+                double series_time = omp_get_wtime() - series_start;
+                stats_add_time(STATS_SERIES, series_time);
+                stats_add_block(current_k, block_end, series_time, 0);
+                if (trace_enabled()) trace_span("binsplit block", series_start, series_start + series_time, current_k, block_end);
+                current_k = block_end;
+
+                // Save checkpoint
+                double save_start = omp_get_wtime();
+                save_tree_checkpoint(checkpoint_file, &stack, saved_ends, &saved_count, digits,
+                                     num_threads, current_flags, quiet_flag, checkpoint_verbose);
+                stats_add_time(STATS_CHECKPOINT_SAVE, omp_get_wtime() - save_start);
+                if (trace_enabled()) trace_span("checkpoint write", save_start, omp_get_wtime(), 0, current_k);
+            }
+
+            if (ret == 0) ret = binsplit_stack_pi(pi, C, &stack, &ctx);
+            binsplit_stack_clear(&stack);
+        }
+
+        mpf_clears(C, global_S, temp, NULL);
+        return ret == 0 ? PI_OK : PI_ERROR_IO;
+    }
+    // ------------------ Binary splitting ends   ---------------------
+
+    // Time spent merging the per-thread sums
+    double total_reduction_time = 0;
+
+    // Contiguous ranges per thread instead of an OpenMP loop schedule
+    bool contiguous = strcmp(omp_schedule, "contiguous") == 0;
+    setup_start = omp_get_wtime();
 
     // Array Block Reduction: Assigns each thread an independent segment and slot
     int max_threads = num_threads; // Number of threads actually used (specified by the user)
     mpf_t* thread_S = (mpf_t*) malloc(max_threads * sizeof(mpf_t));
-    if (!thread_S) {
-        fprintf(stderr, "Error: Failed to allocate thread_S array\n");
-        clean_constants();
+    // Worker state lives for the whole run, so checkpoint blocks keep warm caches and grown buffers
+    ThreadVariables* workers = (ThreadVariables*) malloc(max_threads * sizeof(ThreadVariables));
+    bool allocated = thread_S && workers;
+    #ifdef ENABLE_CACHE
+    ThreadCache* caches = (ThreadCache*) malloc(max_threads * sizeof(ThreadCache));
+    allocated = allocated && caches;
+    #endif
+    if (!allocated) {
+        if (!quiet_flag) fprintf(stderr, "Error: Failed to allocate worker state\n");
+        free(thread_S);
+        free(workers);
+        #ifdef ENABLE_CACHE
+        free(caches);
+        #endif
+        checkpoint_writer_destroy(checkpoint_writer);
         mpf_clears(C, global_S, temp, NULL);
-        exit(1);
+        return PI_ERROR_OUT_OF_MEMORY;
     }
-    for (int i = 0; i < max_threads; i++) {
-        mpf_init_set_ui(thread_S[i], 0);
+
+    // Each worker allocates its own buffers and thread_S slot, sized for the largest term it will
+    // evaluate; in NUMA mode after pinning, so the pages are first touched on its node
+    unsigned long last_block = 0;
+    if (enable_checkpoint && iterations > start_k) {
+        last_block = start_k + (iterations - 1 - start_k) / checkpoint_freq * checkpoint_freq;
     }
+    #pragma omp parallel
+    {
+        int nt = omp_get_num_threads();
+        numa_bind_thread(omp_get_thread_num());
+        for (int i = omp_get_thread_num(); i < max_threads; i += nt) {
+            mpf_init2(thread_S[i], prec);
+
+            // With contiguous ranges a worker never goes past the end of its range in the last block
+            unsigned long max_k = iterations - 1;
+            if (contiguous) {
+                max_k = last_block + (iterations - last_block) * (i + 1) / max_threads;
+                if (max_k > 0) max_k--;
+            }
+
+            init_thread_variables(&workers[i], max_k, prec, constants);
+            #ifdef ENABLE_BLOCK_FACTORIAL
+            workers[i].block_size = block_size; // Set block size for block factorial
+            #endif
+            #ifdef ENABLE_PRECISION_TAPER
+            init_precision_bands(&workers[i], iterations); // Sums by precision band
+            #endif
+
+            #ifdef ENABLE_CACHE
+            init_thread_cache(&caches[i], max_k);
+            #endif
+        }
+    }
+
+    stats_add_time(STATS_SETUP, omp_get_wtime() - setup_start);
 
     // ------------------ Checkpoint code begins ---------------------
     unsigned long current_k = enable_checkpoint ? start_k : 0;
@@ -367,110 +786,209 @@ void calculate_pi(mpf_t pi, unsigned long digits, int num_threads, const char *o
 
         // ------------------ Checkpoint code ends   ---------------------
 
-        #pragma omp parallel shared(global_S, thread_S, CONST_X_BASE, CONST_L_K, CONST_L_ADD, completed_count, show_progress, progress_freq)
+        // Wall times of this block's evaluation and reduction (set by the master thread)
+        double block_start = omp_get_wtime(), block_series = 0, block_reduction = 0;
+
+        #pragma omp parallel shared(global_S, thread_S, workers, completed_count, show_progress, progress_freq)
         {
             int tid = omp_get_thread_num(); // Get the current thread ID
-            ThreadVariables var; // Thread private variables
-            init_thread_variables(&var); // Initialize thread variables
-            #ifdef ENABLE_BLOCK_FACTORIAL
-            var.block_size = block_size; // Set block size for block factorial
-            #endif
+            numa_bind_thread(tid); // Keep the worker on the node its buffers live on
+            double compute_start = omp_get_wtime();
+            unsigned long terms = 0; // Terms evaluated by this thread in this block
+            bool tracing = trace_enabled();
+            unsigned long chunk_begin = 0, chunk_end = 0; // Terms of the current chunk (--trace)
+            double chunk_start = 0, chunk_stop = 0;
+            ThreadVariables* var = &workers[tid]; // Thread private variables, kept across blocks
+            reset_thread_sums(var); // This block's segment starts from zero
 
             #ifdef ENABLE_CACHE
-            ThreadCache cache; // Thread var cache
-            init_thread_cache(&cache); // Initialize thread cache
+            ThreadCache* cache = &caches[tid]; // Thread var cache, still warm from the previous block
             #endif
 
-            // calculate_pi: for (unsigned long k = 0; k < iterations; k++) {
-            #pragma omp for schedule(runtime)
-            for (unsigned long k = enable_checkpoint ? current_k : 0; k < block_end; k++) {
-                mpz_set_ui(var.K, k);
-
-                // Calculate M = (6k)! / ((3k)! * (k!)^3)
-                #ifdef ENABLE_CACHE
-                calculate_M(k, &var, &cache);
-                #else
-                calculate_M(k, &var);
-                #endif
-
-                // Calculate L = 545140134k + 13591409
-                calculate_L(k, &var);
-
-                // Calculate X = (-262537412640768000)^k
-                #ifdef ENABLE_CACHE
-                calculate_X(k, &var, &cache);
-                #else
-                calculate_X(k, &var);
-                #endif
-
-                // Calculate the current item: term = M * L / X
-                calculate_term(k, &var);
-
-                // Accumulate to thread private variables
-                mpf_add(var.S, var.S, var.term);
-
-                #ifdef ENABLE_CACHE
-                // Set cache variables
-                set_cache(k, &cache, &var);
-                #endif
-
-                // Progress display: Atomic counter update (only when progress is enabled)
-                if (show_progress) {
-                    #pragma omp atomic
-                    ++completed_count;
-
-                    if (completed_count % progress_freq == 0 && tid == 0) {
-                        // Use the thread ID to determine execution on the main thread
-                        fprintf(stderr, "\rProgress: %.2f%%", (double) completed_count / iterations * 100);
-                        fflush(stderr);
+            if (contiguous) {
+                // One contiguous range per thread: the first term is computed in full,
+                // the following ones by the exact ratios to their predecessor
+                unsigned long first_k = enable_checkpoint ? current_k : 0;
+                unsigned long range = block_end - first_k;
+                int nt = omp_get_num_threads();
+                unsigned long range_begin = first_k + range * tid / nt;
+                unsigned long range_end = first_k + range * (tid + 1) / nt;
+                terms = range_end - range_begin;
+
+                for (unsigned long k = range_begin; k < range_end; k++) {
+                    if (k == range_begin) {
+                        #ifdef ENABLE_CACHE
+                        PERF_PHASE(PERF_CALCULATE_M, calculate_M(k, var, cache));
+                        PERF_PHASE(PERF_CALCULATE_X, calculate_X(k, var, cache));
+                        #else
+                        PERF_PHASE(PERF_CALCULATE_M, calculate_M(k, var));
+                        PERF_PHASE(PERF_CALCULATE_X, calculate_X(k, var));
+                        #endif
+                    } else {
+                        PERF_PHASE(PERF_ADVANCE_M_X, advance_M_X(k, var));
+                    }
+
+                    // Calculate L = 545140134k + 13591409
+                    calculate_L(k, var);
+
+                    // Calculate the current item: term = M * L / X
+                    PERF_PHASE(PERF_CALCULATE_TERM, calculate_term(k, var));
+
+                    // Accumulate to thread private variables
+                    #ifdef ENABLE_PRECISION_TAPER
+                    accumulate_term(k, var);
+                    #else
+                    mpf_add(var->S, var->S, var->term);
+                    #endif
+
+                    if (show_progress) {
+                        report_progress(tid, &completed_count, iterations, progress_freq);
+                    }
+                }
+                if (tracing) trace_span("terms", compute_start, omp_get_wtime(), range_begin, range_end);
+            } else {
+                // calculate_pi: for (unsigned long k = 0; k < iterations; k++) {
+                #pragma omp for schedule(runtime)
+                for (unsigned long k = enable_checkpoint ? current_k : 0; k < block_end; k++) {
+                    if (tracing && k != chunk_end) {
+                        // A new chunk from the schedule: close the previous one
+                        if (chunk_end > chunk_begin) trace_span("terms", chunk_start, chunk_stop, chunk_begin, chunk_end);
+                        chunk_begin = k;
+                        chunk_start = omp_get_wtime();
+                    }
+                    mpz_set_ui(var->K, k);
+
+                    // Calculate M = (6k)! / ((3k)! * (k!)^3)
+                    #ifdef ENABLE_CACHE
+                    PERF_PHASE(PERF_CALCULATE_M, calculate_M(k, var, cache));
+                    #else
+                    PERF_PHASE(PERF_CALCULATE_M, calculate_M(k, var));
+                    #endif
+
+                    // Calculate L = 545140134k + 13591409
+                    calculate_L(k, var);
+
+                    // Calculate X = (-262537412640768000)^k
+                    #ifdef ENABLE_CACHE
+                    PERF_PHASE(PERF_CALCULATE_X, calculate_X(k, var, cache));
+                    #else
+                    PERF_PHASE(PERF_CALCULATE_X, calculate_X(k, var));
+                    #endif
+
+                    // Calculate the current item: term = M * L / X
+                    PERF_PHASE(PERF_CALCULATE_TERM, calculate_term(k, var));
+
+                    // Accumulate to thread private variables
+                    #ifdef ENABLE_PRECISION_TAPER
+                    accumulate_term(k, var);
+                    #else
+                    mpf_add(var->S, var->S, var->term);
+                    #endif
+
+                    #ifdef ENABLE_CACHE
+                    // Set cache variables
+                    set_cache(k, cache, var);
+                    #endif
+                    terms++;
+
+                    // Progress display: Atomic counter update (only when progress is enabled)
+                    if (show_progress) {
+                        report_progress(tid, &completed_count, iterations, progress_freq);
+                    }
+
+                    if (tracing) {
+                        chunk_end = k + 1;
+                        chunk_stop = omp_get_wtime();
                     }
                 }
+                if (chunk_end > chunk_begin) trace_span("terms", chunk_start, chunk_stop, chunk_begin, chunk_end);
             }
 
+            #ifdef ENABLE_PRECISION_TAPER
+            merge_precision_bands(var); // Fold the band sums into S
+            #endif
+
             // Store the segment of this thread into the corresponding array slot
-            mpf_set(thread_S[tid], var.S);
+            mpf_set(thread_S[tid], var->S);
 
-            clean_thread_variables(&var); // Clean up thread variables
+            double compute_end = omp_get_wtime();
+            if (numa_enabled()) {
+                numa_add_compute_time(tid, compute_end - compute_start);
+            }
 
-            #ifdef ENABLE_CACHE
-            clean_thread_cache(&cache); // Clean up thread cache
-            #endif
+            // Pairwise reduction of the segments into thread_S[0]
+            #pragma omp barrier
+            double reduction_start = omp_get_wtime();
+            stats_add_thread(tid, compute_end - compute_start, reduction_start - compute_end, terms);
+            if (tracing) trace_span("barrier wait", compute_end, reduction_start, 0, 0);
+            if (numa_enabled()) {
+                PERF_PHASE(PERF_REDUCTION, reduce_thread_sums_numa(thread_S, tid, omp_get_num_threads()));
+            } else {
+                PERF_PHASE(PERF_REDUCTION, reduce_thread_sums(thread_S, tid, omp_get_num_threads()));
+            }
+
+            if (tracing) trace_span("reduction", reduction_start, omp_get_wtime(), 0, 0);
+
+            #pragma omp master
+            {
+                mpf_add(global_S, global_S, thread_S[0]);
+                block_series = reduction_start - block_start;
+                block_reduction = omp_get_wtime() - reduction_start;
+                total_reduction_time += block_reduction;
+            }
         } // End of parallel section
 
-        // The main thread merges all parts
-        for (int i = 0; i < max_threads; i++) {
-            mpf_add(global_S, global_S, thread_S[i]);
-        }
+        stats_add_time(STATS_SERIES, block_series);
+        stats_add_time(STATS_REDUCTION, block_reduction);
+        stats_add_block(enable_checkpoint ? current_k : 0, block_end, block_series, block_reduction);
 
         // ------------------ Checkpoint code begins ---------------------
         if (enable_checkpoint) {
             current_k = block_end;
 
             // Save checkpoint
-
-            if (save_checkpoint(checkpoint_file, current_k, global_S, digits,
-                                (uint32_t) num_threads, current_flags, quiet_flag) != 0) {
-                if (!quiet_flag) fprintf(stderr, "Warning: Failed to save checkpoint\n");
-            } else if (checkpoint_verbose && !quiet_flag) {
-                fprintf(stderr, "\nCheckpoint saved at iteration %lu\n", current_k);
-            }
+            double save_start = omp_get_wtime();
+            save_block_checkpoint(checkpoint_writer, checkpoint_file, current_k, global_S, digits,
+                                  num_threads, current_flags, quiet_flag, checkpoint_verbose);
+            stats_add_time(STATS_CHECKPOINT_SAVE, omp_get_wtime() - save_start);
         } else {
             break;
         }
     } // End of while section
     // ------------------ Checkpoint code ends   ---------------------
 
+    if (reduction_time) *reduction_time = total_reduction_time;
+
     // Calculate PI = C / S
+    double division_start = omp_get_wtime();
     mpf_div(pi, C, global_S);
+    stats_add_time(STATS_DIVISION, omp_get_wtime() - division_start);
+    if (trace_enabled()) trace_span("division", division_start, omp_get_wtime(), 0, 0);
 
-    // Clean up global constants
-    clean_constants();
+    // Wait for the last checkpoint to reach the disk
+    double save_start = omp_get_wtime();
+    checkpoint_writer_destroy(checkpoint_writer);
+    stats_add_time(STATS_CHECKPOINT_SAVE, omp_get_wtime() - save_start);
 
-    // Clean the thread_S array
+    // Clean the thread_S array and the worker state
+    #ifdef DEBUG
+    unsigned long cache_hit_count = 0; // Count cache hits
+    #endif
     for (int i = 0; i < max_threads; i++) {
+        #ifdef DEBUG
+        cache_hit_count += workers[i].cache_hits;
+        #endif
         mpf_clear(thread_S[i]);
+        clean_thread_variables(&workers[i]);
+        #ifdef ENABLE_CACHE
+        clean_thread_cache(&caches[i]);
+        #endif
     }
     free(thread_S);
+    free(workers);
+    #ifdef ENABLE_CACHE
+    free(caches);
+    #endif
 
     // Clean up variables
     mpf_clears(C, global_S, temp, NULL);
@@ -479,153 +997,476 @@ void calculate_pi(mpf_t pi, unsigned long digits, int num_threads, const char *o
     printf("Cache hit count: %lu\n", cache_hit_count);
     printf("Cache hit ratio: %.2f%%\n", (double) cache_hit_count / (iterations * 2) * 100);
     #endif
+    return PI_OK;
 }
 
-// Write the PI value to file
-void write_pi_to_file(const mpf_t pi, unsigned long digits, const char* filename, double computation_time,
-    bool format_output, size_t buffer_size, bool raw_output) {
-    FILE* file = fopen(filename, raw_output ? "wb" : "w");
-    if (!file) {
-        perror("Failed to open file");
-        return;
+// Buffered writer for the decimal digits after "3.", fed in pieces of any size
+typedef struct {
+    FILE* stream;
+    IoWriter* io;               // Asynchronous engine writing the file instead of stream (--io-engine)
+    char* buffer;
+    size_t buffer_size;
+    size_t buffer_index;
+    bool format_output;
+    DigitFormat output_format;
+    char pending[DIGIT_FORMAT_U64_DIGITS];  // Digits of an incomplete binary group
+    size_t pending_len;
+    unsigned long written;      // Number of digits written so far
+    unsigned long skip;         // Leading digits to drop (the "3" in front of the decimal point)
+    unsigned long remaining;    // Digits still to be written
+    int64_t layout_base;        // File offset of the formatted digits when they are pwritten, -1 for stdio
+    bool failed;                // A write failed
+    double write_time;          // Time spent formatting and writing
+    unsigned long long bytes;   // Bytes handed to the stream
+    #ifdef DEBUG
+    int flush_count;            // Count the number of times the buffer is flushed
+    #endif
+} DigitWriter;
+
+// Write the buffer to the stream
+static void digit_writer_flush(DigitWriter* writer) {
+    if (writer->buffer_index == 0) return;
+    if (writer->io) {
+        io_writer_write(writer->io, writer->buffer, writer->buffer_index);
+    } else if (fwrite(writer->buffer, sizeof(char), writer->buffer_index, writer->stream) != writer->buffer_index) {
+        if (!writer->failed) perror("Failed to write the digits");
+        writer->failed = true;
     }
-    write_pi_to_stream(pi, digits, file, computation_time, format_output, buffer_size, raw_output);
-    fclose(file);
+    writer->bytes += writer->buffer_index;
+    writer->buffer_index = 0;
+
+    #ifdef DEBUG
+    ++writer->flush_count;
+    #endif
 }
 
-// Write the PI value to stream
-void write_pi_to_stream(const mpf_t pi, unsigned long digits, FILE* stream, double computation_time,
-    bool format_output, size_t buffer_size, bool raw_output) {
-    // Write header only if not in raw mode
-    if (!raw_output) {
-        fprintf(stream, "Pi calculated to %lu digits. ", digits);
-        fprintf(stream, "Computation time: %.2f seconds.\n\n", computation_time);
+// Append one character to the buffer
+static void digit_writer_putc(DigitWriter* writer, char c) {
+    if (writer->buffer_index > writer->buffer_size - 1) {
+        digit_writer_flush(writer);
+    }
+    writer->buffer[writer->buffer_index++] = c;
+}
+
+// Append len bytes as they are
+static void digit_writer_append(DigitWriter* writer, const char* data, size_t len) {
+    while (len > 0) {
+        size_t chunk = writer->buffer_size - writer->buffer_index;
+        if (chunk > len) chunk = len;
+        memcpy(writer->buffer + writer->buffer_index, data, chunk);
+        writer->buffer_index += chunk;
+        data += chunk;
+        len -= chunk;
+        if (writer->buffer_index == writer->buffer_size) {
+            digit_writer_flush(writer);
+        }
     }
+}
 
-    mp_exp_t exp;
-    // Obtain the string representation of PI
-    char* pi_str = mpf_get_str(NULL, &exp, 10, digits + 2, pi);
-    if (!pi_str) {
-        fprintf(stderr, "Failed to convert pi to string\n");
+// Encode whole groups of digits into the buffer
+static void digit_writer_encode(DigitWriter* writer, const char* digits, size_t groups) {
+    size_t group_digits = digit_format_group_digits(writer->output_format);
+    size_t group_bytes = digit_format_group_bytes(writer->output_format);
+    while (groups > 0) {
+        size_t room = (writer->buffer_size - writer->buffer_index) / group_bytes;
+        if (room == 0) {
+            digit_writer_flush(writer);
+            continue;
+        }
+        size_t n = groups < room ? groups : room;
+        writer->buffer_index += digit_format_encode(writer->output_format, digits, n,
+            (unsigned char*) writer->buffer + writer->buffer_index);
+        digits += n * group_digits;
+        groups -= n;
+    }
+}
+
+// Append len digits in a binary format; a group split between two calls waits in pending
+static void digit_writer_put_encoded(DigitWriter* writer, const char* digits, size_t len) {
+    size_t group_digits = digit_format_group_digits(writer->output_format);
+    if (writer->pending_len > 0) {
+        size_t n = group_digits - writer->pending_len;
+        if (n > len) n = len;
+        memcpy(writer->pending + writer->pending_len, digits, n);
+        writer->pending_len += n;
+        digits += n;
+        len -= n;
+        if (writer->pending_len < group_digits) return;
+        digit_writer_encode(writer, writer->pending, 1);
+        writer->pending_len = 0;
+    }
+
+    size_t groups = len / group_digits;
+    digit_writer_encode(writer, digits, groups);
+    writer->pending_len = len - groups * group_digits;
+    memcpy(writer->pending, digits + groups * group_digits, writer->pending_len);
+}
+
+// Encode the last incomplete group, padded with zero digits
+static void digit_writer_finish(DigitWriter* writer) {
+    if (writer->output_format == DIGIT_FORMAT_TEXT || writer->pending_len == 0) return;
+    size_t group_digits = digit_format_group_digits(writer->output_format);
+    memset(writer->pending + writer->pending_len, '0', group_digits - writer->pending_len);
+    digit_writer_encode(writer, writer->pending, 1);
+    writer->pending_len = 0;
+}
+
+// Write the formatted layout of a regular file with parallel positioned writes from here on
+// (an I/O engine keeps the sequential layout and overlaps it with its queued writes instead)
+static void digit_writer_begin(DigitWriter* writer) {
+    writer->layout_base = -1;
+    if (writer->format_output && writer->output_format == DIGIT_FORMAT_TEXT && !writer->io) {
+        digit_writer_flush(writer);
+        writer->layout_base = text_layout_begin(writer->stream);
+    }
+}
+
+// Move the stream past the positioned writes and push out what stdio still buffers
+static void digit_writer_end(DigitWriter* writer) {
+    if (writer->io) return;
+    bool positioned = writer->layout_base < 0 ||
+        text_layout_end(writer->stream, writer->layout_base, writer->written) == 0;
+    if ((!positioned || fflush(writer->stream) != 0 || ferror(writer->stream)) && !writer->failed) {
+        perror("Failed to write the digits");
+        writer->failed = true;
+    }
+}
+
+// Append len digits, laid out like the formatted or unformatted output
+static void digit_writer_put(DigitWriter* writer, const char* digits, size_t len) {
+    if (digit_cache_recording()) digit_cache_append(digits, len);
+
+    if (writer->output_format != DIGIT_FORMAT_TEXT) {
+        digit_writer_put_encoded(writer, digits, len);
         return;
     }
 
-    // Adjust the exponent to get the correct number of digits
-    if(exp != 1) {
-        fprintf(stderr, "Unexpected exponent value: %ld\n", exp);
-        free(pi_str);
+    if (!writer->format_output) {
+        // Write directly without formatting
+        digit_writer_append(writer, digits, len);
         return;
     }
 
-    // In raw mode: write "3." + digits (no extra newline after "3.")
-    fprintf(stream,"3.");
-    if (!raw_output) {
-        fprintf(stream, "\n");
+    if (writer->layout_base >= 0) {
+        // Formatted in parallel and written at the offsets the layout gives
+        int64_t bytes = text_layout_pwrite(writer->stream, writer->layout_base, digits, len, writer->written,
+            writer->buffer_size);
+        if (bytes < 0) {
+            if (!writer->failed) perror("Failed to write the digits");
+            writer->failed = true;
+        } else {
+            writer->bytes += (unsigned long long) bytes;
+        }
+        writer->written += len;
+        return;
     }
 
-    #ifdef DEBUG
-    int flush_count = 0; // Count the number of times the buffer is flushed
-    #endif
+    // Every 100 characters on a line, add spaces every 10 characters
+    while (len > 0) {
+        unsigned long position = writer->written; // Digits before this block
+        if (position > 0 && position % 10 == 0) {
+            // Line break between lines, space between blocks (nothing after the last digit)
+            digit_writer_putc(writer, position % 100 == 0 ? '\n' : ' ');
+        }
 
-    // Allocate buffer dynamically based on the specified size
-    char* buffer = (char*)malloc(buffer_size);
-    if (!buffer) {
-        perror("malloc failed");
-        free(pi_str);
+        // Copy up to the end of the current 10-character block
+        size_t block_length = 10 - position % 10;
+        if (block_length > len) block_length = len;
+        if (writer->buffer_index + block_length >= writer->buffer_size) {
+            digit_writer_flush(writer);
+        }
+        memcpy(writer->buffer + writer->buffer_index, digits, block_length);
+        writer->buffer_index += block_length;
+        writer->written += block_length;
+        digits += block_length;
+        len -= block_length;
+    }
+}
+
+// Sink for the streaming conversion: drop the integer part and the guard digit, then write
+static void digit_writer_sink(const char* digits, size_t len, void* arg) {
+    DigitWriter* writer = (DigitWriter*) arg;
+    double start = omp_get_wtime();
+
+    size_t skip = writer->skip < len ? writer->skip : len;
+    writer->skip -= skip;
+    digits += skip;
+    len -= skip;
+
+    if (len > writer->remaining) len = writer->remaining;
+    writer->remaining -= len;
+    digit_writer_put(writer, digits, len);
+
+    writer->write_time += omp_get_wtime() - start;
+}
+
+// Write the header (unless raw) and the integer part in front of the digits ("3." or "11." in binary),
+// or the header of a binary format
+static void write_pi_header(DigitWriter* writer, unsigned long digits, double computation_time, bool raw_output,
+    DigitFormat output_format, int radix) {
+    if (output_format != DIGIT_FORMAT_TEXT) {
+        unsigned char header[DIGIT_FORMAT_HEADER_SIZE];
+        digit_format_header(header, output_format, digits, computation_time);
+        digit_writer_append(writer, (const char*) header, sizeof(header));
         return;
     }
-    size_t buffer_index = 0;
 
-    if(format_output) {
-        // Block write optimization: every 100 characters on a line, add spaces every 10 characters
-        for (unsigned long line_start = 1; line_start <= digits; line_start += 100) {
-            unsigned long line_end = line_start + 100;
-            if (line_end > digits + 1) line_end = digits + 1;
+    char text[160];
+    int len = 0;
+    // Write header only if not in raw mode
+    if (!raw_output) {
+        const char* radix_name = radix == 16 ? "hexadecimal " : radix == 2 ? "binary " : "";
+        len += snprintf(text + len, sizeof(text) - len, "Pi calculated to %lu %sdigits. ", digits, radix_name);
+        len += snprintf(text + len, sizeof(text) - len, "Computation time: %.2f seconds.\n\n", computation_time);
+    }
 
-            // Process blocks of every 10 characters
-            for (unsigned long block_start = line_start; block_start < line_end; block_start += 10) {
-                    unsigned long block_end = block_start + 10;
-                if (block_end > line_end) block_end = line_end;
+    // In raw mode: write "3." + digits (no extra newline after "3.")
+    len += snprintf(text + len, sizeof(text) - len, "%s%s", radix == 2 ? "11." : "3.", raw_output ? "" : "\n");
+    digit_writer_append(writer, text, (size_t) len);
+}
 
-                // Copy character block
-                size_t block_length = block_end - block_start;
-                if (buffer_index + block_length >= buffer_size) {
-                    // Buffer full, write to file
-                    fwrite(buffer, sizeof(char), buffer_index, stream);
-                    buffer_index = 0;
+// The digits after the point in radix 2 or 16: linear-time extraction streamed through the writer
+static void write_pi_pow2(DigitWriter* writer, const mpf_t pi, unsigned long digits, int radix,
+    double* conversion_time) {
+    writer->remaining = digits;
+    digit_writer_begin(writer);
+    double conversion_start = omp_get_wtime();
+    if (radix_stream_pow2(pi, radix, digits, writer->buffer_size, digit_writer_sink, writer) != 0) {
+        fprintf(stderr, "Failed to convert pi to string\n");
+        writer->failed = true;
+    }
+    double flush_start = omp_get_wtime();
+    digit_writer_flush(writer);
+    digit_writer_end(writer);
+    writer->write_time += omp_get_wtime() - flush_start;
+    double conversion = omp_get_wtime() - conversion_start - writer->write_time;
+    if (conversion_time) *conversion_time = conversion;
+
+    stats_add_time(STATS_CONVERSION, conversion);
+    stats_add_time(STATS_WRITE, writer->write_time);
+    if (trace_enabled()) {
+        trace_span("conversion", conversion_start, conversion_start + conversion, 0, 0);
+        trace_span("write", conversion_start + conversion, omp_get_wtime(), 0, 0);
+    }
+    stats_add_output(writer->bytes);
+}
 
-                    #ifdef DEBUG
-                    ++flush_count;
-                    #endif
-                }
-                memcpy(buffer + buffer_index, pi_str + block_start, block_length);
-                buffer_index += block_length;
-
-                // Add spaces (do not add to the last block)
-                if (block_end < line_end) {
-                    if (buffer_index > buffer_size - 1) {
-                        // Buffer full, write to file
-                        fwrite(buffer, sizeof(char), buffer_index, stream);
-                        buffer_index = 0;
-
-                        #ifdef DEBUG
-                        ++flush_count;
-                        #endif
-                    }
-                    buffer[buffer_index++] = ' ';
-                }
-            }
+// Write the PI value to stream, or to io if it is not NULL. Returns 0 on success
+static int write_pi_output(const mpf_t pi, unsigned long digits, FILE* stream, IoWriter* io,
+    double computation_time, bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format,
+    int radix, bool stream_output, double* conversion_time) {
+    // Allocate buffer dynamically based on the specified size
+    DigitWriter writer = { 0 };
+    writer.stream = stream;
+    writer.io = io;
+    writer.buffer = (char*)malloc(buffer_size);
+    writer.buffer_size = buffer_size;
+    writer.format_output = format_output;
+    writer.output_format = output_format;
+    if (!writer.buffer) {
+        perror("malloc failed");
+        return -1;
+    }
+    write_pi_header(&writer, digits, computation_time, raw_output, output_format, radix);
+    if (radix != 10) {
+        write_pi_pow2(&writer, pi, digits, radix, conversion_time);
+        free(writer.buffer);
+        return writer.failed ? -1 : 0;
+    }
 
-            // Add line breaks (do not add to the last line)
-            if (line_end <= digits) {
-                if (buffer_index > buffer_size - 1) {
-                    // Buffer full, write to file
-                    fwrite(buffer, sizeof(char), buffer_index, stream);
-                    buffer_index = 0;
+    // With an I/O engine the conversion of each chunk overlaps the queued writes of the previous ones
+    if (io) stream_output = true;
 
-                    #ifdef DEBUG
-                    ++flush_count;
-                    #endif
-                }
-                buffer[buffer_index++] = '\n';
-            }
+    mp_exp_t exp;
+    mpz_t N;
+    char* pi_str = NULL;
+    double conversion = 0; // Radix conversion time
+    double conversion_start = omp_get_wtime();
+
+    if (stream_output) {
+        // Only the integer form is built here; the text is produced chunk by chunk below
+        mpz_init(N);
+        radix_scale_digits(N, &exp, digits + 2, pi);
+    } else {
+        // Obtain the string representation of PI (parallel divide-and-conquer conversion)
+        pi_str = radix_get_str(&exp, digits + 2, pi);
+        conversion = omp_get_wtime() - conversion_start;
+        if (conversion_time) *conversion_time = conversion;
+        if (!pi_str) {
+            fprintf(stderr, "Failed to convert pi to string\n");
+            free(writer.buffer);
+            return -1;
         }
+    }
+
+    // Adjust the exponent to get the correct number of digits
+    if(exp != 1) {
+        fprintf(stderr, "Unexpected exponent value: %ld\n", exp);
+        if (stream_output) mpz_clear(N);
+        free(pi_str);
+        free(writer.buffer);
+        return -1;
+    }
 
-        // Write remaining buffer to file
-        if (buffer_index > 0) {
-            fwrite(buffer, sizeof(char), buffer_index, stream);
+    writer.skip = 1;                // Skip '3'
+    writer.remaining = digits;
+    digit_writer_begin(&writer);
 
-            #ifdef DEBUG
-            ++flush_count;
-            #endif
+    if (stream_output) {
+        // Conversion and writing alternate; the buffer size doubles as the chunk size
+        if (radix_stream(N, digits + 2, buffer_size, digit_writer_sink, &writer) != 0) {
+            fprintf(stderr, "Failed to convert pi to string\n");
+            writer.failed = true;
         }
-
+        conversion = omp_get_wtime() - conversion_start - writer.write_time;
+        if (conversion_time) *conversion_time = conversion;
     } else {
-        // Write directly without formatting.
-        size_t offset = 1; // Skip '3.'
-        unsigned long remaining = digits;
-        size_t pi_strlen = strlen(pi_str);
-        while (remaining > 0) {
-            // Calculate the chunk size
-            size_t chunk = (remaining > buffer_size) ? buffer_size : remaining;
-            if (offset + chunk > pi_strlen) chunk = pi_strlen - offset;
-
-            // Copy the chunk to the buffer
-            memcpy(buffer, pi_str + offset, chunk);
-            fwrite(buffer, sizeof(char), chunk, stream);
-            offset += chunk;
-            remaining -= chunk;
-
-            #ifdef DEBUG
-            ++flush_count;
-            #endif
-        }
+        double write_start = omp_get_wtime();
+        digit_writer_put(&writer, pi_str + 1, digits);
+        writer.write_time += omp_get_wtime() - write_start;
+    }
+
+    // Write remaining buffer to file
+    double flush_start = omp_get_wtime();
+    digit_writer_finish(&writer);
+    digit_writer_flush(&writer);
+    digit_writer_end(&writer);
+    writer.write_time += omp_get_wtime() - flush_start;
+
+    stats_add_time(STATS_CONVERSION, conversion);
+    stats_add_time(STATS_WRITE, writer.write_time);
+    if (trace_enabled()) {
+        // Streaming alternates the two; the spans show their totals back to back
+        trace_span("conversion", conversion_start, conversion_start + conversion, 0, 0);
+        trace_span("write", conversion_start + conversion, omp_get_wtime(), 0, 0);
     }
+    stats_add_output(writer.bytes);
 
     #ifdef DEBUG
-    printf("Buffer flush count: %d\n", flush_count); // Number of times the buffer was flushed
+    printf("Buffer flush count: %d\n", writer.flush_count); // Number of times the buffer was flushed
     #endif
 
-    free(buffer);
+    free(writer.buffer);
     free(pi_str);
+    return writer.failed ? -1 : 0;
+}
+
+// Write the PI value to stream
+int write_pi_to_stream(const mpf_t pi, unsigned long digits, FILE* stream, double computation_time,
+    bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format, int radix,
+    bool stream_output, double* conversion_time) {
+    return write_pi_output(pi, digits, stream, NULL, computation_time, format_output, buffer_size, raw_output,
+        output_format, radix, stream_output, conversion_time);
+}
+
+// Wait for the queued writes of an I/O engine and close its file; returns 0 on success
+static int close_io_writer(IoWriter* io) {
+    double close_start = omp_get_wtime();
+    int ret = io_writer_close(io);
+    stats_add_time(STATS_WRITE, omp_get_wtime() - close_start);
+    if (ret != 0) perror("Failed to write file");
+    return ret;
+}
+
+// Write the PI value to file
+int write_pi_to_file(const mpf_t pi, unsigned long digits, const char* filename, double computation_time,
+    bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format, int radix,
+    bool stream_output, double* conversion_time) {
+    IoWriter* io = io_writer_open(filename, buffer_size);
+    if (io) {
+        int ret = write_pi_output(pi, digits, NULL, io, computation_time, format_output, buffer_size, raw_output,
+            output_format, radix, stream_output, conversion_time);
+        if (close_io_writer(io) != 0) ret = -1;
+        return ret;
+    }
+
+    FILE* file = fopen(filename, raw_output || output_format != DIGIT_FORMAT_TEXT ? "wb" : "w");
+    if (!file) {
+        perror("Failed to open file");
+        return -1;
+    }
+    int ret = write_pi_to_stream(pi, digits, file, computation_time, format_output, buffer_size, raw_output,
+        output_format, radix, stream_output, conversion_time);
+    if (fclose(file) != 0) {
+        perror("Failed to write file");
+        ret = -1;
+    }
+    return ret;
+}
+
+// Write decimals read from source to stream, or to io if it is not NULL
+static int write_pi_digits_output(DigitSource source, void* arg, unsigned long digits, FILE* stream, IoWriter* io,
+    double computation_time, bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format) {
+    DigitWriter writer = { 0 };
+    writer.stream = stream;
+    writer.io = io;
+    writer.buffer = (char*)malloc(buffer_size);
+    writer.buffer_size = buffer_size;
+    writer.format_output = format_output;
+    writer.output_format = output_format;
+    char* chunk = (char*)malloc(buffer_size);
+    if (!writer.buffer || !chunk) {
+        perror("malloc failed");
+        free(writer.buffer);
+        free(chunk);
+        return -1;
+    }
+
+    double write_start = omp_get_wtime();
+    write_pi_header(&writer, digits, computation_time, raw_output, output_format, 10);
+    digit_writer_begin(&writer);
+    unsigned long remaining = digits;
+    while (remaining > 0) {
+        size_t len = remaining < buffer_size ? remaining : buffer_size;
+        size_t read = source(chunk, len, arg);
+        if (read == 0) break;
+        digit_writer_put(&writer, chunk, read);
+        remaining -= read;
+    }
+    digit_writer_finish(&writer);
+    digit_writer_flush(&writer);
+    digit_writer_end(&writer);
+
+    double write_end = omp_get_wtime();
+    stats_add_time(STATS_WRITE, write_end - write_start);
+    trace_span("write", write_start, write_end, 0, 0);
+    stats_add_output(writer.bytes);
+
+    free(writer.buffer);
+    free(chunk);
+    if (writer.failed) return -1;
+    if (remaining > 0) {
+        fprintf(stderr, "Failed to read the digits (%lu missing)\n", remaining);
+        return -1;
+    }
+    return 0;
+}
+
+// Write decimals read from source, laid out like write_pi_to_stream
+int write_pi_digits_to_stream(DigitSource source, void* arg, unsigned long digits, FILE* stream,
+    double computation_time, bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format) {
+    return write_pi_digits_output(source, arg, digits, stream, NULL, computation_time, format_output, buffer_size,
+        raw_output, output_format);
+}
+
+// Write decimals read from source to file
+int write_pi_digits_to_file(DigitSource source, void* arg, unsigned long digits, const char* filename,
+    double computation_time, bool format_output, size_t buffer_size, bool raw_output, DigitFormat output_format) {
+    IoWriter* io = io_writer_open(filename, buffer_size);
+    if (io) {
+        int ret = write_pi_digits_output(source, arg, digits, NULL, io, computation_time, format_output,
+            buffer_size, raw_output, output_format);
+        if (close_io_writer(io) != 0) ret = -1;
+        return ret;
+    }
+
+    FILE* file = fopen(filename, raw_output || output_format != DIGIT_FORMAT_TEXT ? "wb" : "w");
+    if (!file) {
+        perror("Failed to open file");
+        return -1;
+    }
+    int ret = write_pi_digits_to_stream(source, arg, digits, file, computation_time, format_output,
+        buffer_size, raw_output, output_format);
+    if (fclose(file) != 0) ret = -1;
+    return ret;
 }
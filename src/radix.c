@@ -0,0 +1,297 @@
+// Divide-and-conquer decimal conversion.
+//
+// The value is scaled to an n-digit integer N and placed in a field of
+// RADIX_LEAF_DIGITS * 2^K digits. With powers[i] = 10^(RADIX_LEAF_DIGITS * 2^i),
+// a field of level i is split as N = q * powers[i-1] + r into two fields of
+// level i-1, until a field is small enough for mpz_get_str. Both halves are
+// independent, so the upper levels run as OpenMP tasks.
+//
+// In streaming mode only fields up to the chunk size are converted to text;
+// larger fields are split and their high half is emitted before the low half
+// is touched, so the digits come out in order one chunk at a time.
+//
+// Radix 2 and 16 need no division at all: a digit is a group of 1 or 4 bits
+// and never straddles a limb, so it is masked out of the scaled integer.
+
+#include "radix.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#define RADIX_LEAF_DIGITS 4096  // Digits converted directly by mpz_get_str
+#define RADIX_TASK_LEVEL  2     // Fields of this level and above are split into tasks
+
+// Write N into out as exactly RADIX_LEAF_DIGITS << level digits (zero padded); N is cleared
+static void radix_convert(mpz_t N, int level, char* out, const mpz_t* powers) {
+    size_t width = (size_t) RADIX_LEAF_DIGITS << level;
+
+    if (mpz_sgn(N) == 0) {
+        memset(out, '0', width);
+        mpz_clear(N);
+        return;
+    }
+
+    if (level == 0) {
+        char leaf[RADIX_LEAF_DIGITS + 2];
+        mpz_get_str(leaf, 10, N);
+        size_t len = strlen(leaf);
+        memset(out, '0', width - len);
+        memcpy(out + width - len, leaf, len);
+        mpz_clear(N);
+        return;
+    }
+
+    mpz_t q, r;
+    mpz_inits(q, r, NULL);
+    mpz_tdiv_qr(q, r, N, powers[level - 1]);
+    mpz_clear(N);
+
+    size_t half = width / 2;
+    if (level >= RADIX_TASK_LEVEL) {
+        #pragma omp task default(none) shared(q) firstprivate(level, out, powers)
+        radix_convert(q, level - 1, out, powers);
+
+        radix_convert(r, level - 1, out + half, powers);
+
+        #pragma omp taskwait
+    } else {
+        radix_convert(q, level - 1, out, powers);
+        radix_convert(r, level - 1, out + half, powers);
+    }
+}
+
+// N = round(x * 10^(n - e))
+static void radix_scale(mpz_t N, const mpf_t x, size_t n_digits, long e) {
+    mpf_t scaled, p;
+    mpz_t power;
+    mp_bitcnt_t prec = (mp_bitcnt_t) (n_digits * log2(10)) + 64;
+
+    mpf_init2(scaled, prec);
+    mpf_init2(p, prec);
+    mpz_init(power);
+
+    long shift = (long) n_digits - e;
+    mpz_ui_pow_ui(power, 10, (unsigned long) labs(shift));
+    mpf_set_z(p, power);
+    if (shift >= 0) {
+        mpf_mul(scaled, x, p);
+    } else {
+        mpf_div(scaled, x, p);
+    }
+
+    // Round half up
+    mpf_set_d(p, 0.5);
+    mpf_add(scaled, scaled, p);
+    mpz_set_f(N, scaled);
+
+    mpz_clear(power);
+    mpf_clears(scaled, p, NULL);
+}
+
+// N = round(x * 10^(n_digits - exp)), the n_digits significant digits of a positive x as an integer
+void radix_scale_digits(mpz_t N, mp_exp_t* exp, size_t n_digits, const mpf_t x) {
+    // Decimal exponent estimate from the binary one, corrected below
+    long bexp;
+    double d = mpf_get_d_2exp(&bexp, x);
+    long e = (long) floor(log10(d) + bexp * log10(2.0)) + 1;
+
+    mpz_t limit;
+    mpz_init(limit);
+    for (;;) {
+        radix_scale(N, x, n_digits, e);
+
+        mpz_ui_pow_ui(limit, 10, n_digits);
+        if (mpz_cmp(N, limit) >= 0) {
+            e++;
+            continue;
+        }
+        mpz_divexact_ui(limit, limit, 10);
+        if (mpz_cmp(N, limit) < 0) {
+            e--;
+            continue;
+        }
+        break;
+    }
+    mpz_clear(limit);
+
+    *exp = e;
+}
+
+// Smallest field level that holds n_digits digits
+static int radix_levels(size_t n_digits) {
+    int levels = 0;
+    while (((size_t) RADIX_LEAF_DIGITS << levels) < n_digits) levels++;
+    return levels;
+}
+
+// powers[i] = 10^(RADIX_LEAF_DIGITS * 2^i) for i < levels
+static mpz_t* radix_powers(int levels) {
+    mpz_t* powers = (mpz_t*) malloc((levels > 0 ? levels : 1) * sizeof(mpz_t));
+    if (!powers) return NULL;
+
+    for (int i = 0; i < levels; i++) {
+        mpz_init(powers[i]);
+        if (i == 0) {
+            mpz_ui_pow_ui(powers[0], 10, RADIX_LEAF_DIGITS);
+        } else {
+            mpz_mul(powers[i], powers[i - 1], powers[i - 1]);
+        }
+    }
+    return powers;
+}
+
+static void radix_clear_powers(mpz_t* powers, int levels) {
+    for (int i = 0; i < levels; i++) {
+        mpz_clear(powers[i]);
+    }
+    free(powers);
+}
+
+// Convert a positive x to its first n_digits significant decimal digits
+char* radix_get_str(mp_exp_t* exp, size_t n_digits, const mpf_t x) {
+    if (n_digits == 0 || mpf_sgn(x) <= 0) return NULL;
+
+    mpz_t N;
+    mpz_init(N);
+    radix_scale_digits(N, exp, n_digits, x);
+
+    int levels = radix_levels(n_digits);
+    size_t width = (size_t) RADIX_LEAF_DIGITS << levels;
+
+    char* field = (char*) malloc(width + 1);
+    mpz_t* powers = radix_powers(levels);
+    if (!field || !powers) {
+        free(field);
+        if (powers) radix_clear_powers(powers, levels);
+        mpz_clear(N);
+        return NULL;
+    }
+
+    #pragma omp parallel default(none) shared(N, levels, field, powers)
+    #pragma omp single
+    radix_convert(N, levels, field, (const mpz_t*) powers);
+
+    radix_clear_powers(powers, levels);
+
+    // Drop the zero padding in front of the number
+    memmove(field, field + width - n_digits, n_digits);
+    field[n_digits] = '\0';
+
+    return field;
+}
+
+// State of a streaming conversion
+typedef struct {
+    const mpz_t* powers;
+    int chunk_level;        // Fields up to this level are converted in one piece
+    char* chunk;            // Text of the current field
+    size_t skip;            // Padding digits in front of the number still to be dropped
+    radix_sink_fn sink;
+    void* arg;
+} RadixStream;
+
+// Emit the field N of the given level in order; N is cleared
+static void radix_stream_field(mpz_t N, int level, RadixStream* rs) {
+    size_t width = (size_t) RADIX_LEAF_DIGITS << level;
+
+    // Entirely inside the leading padding
+    if (mpz_sgn(N) == 0 && rs->skip >= width) {
+        rs->skip -= width;
+        mpz_clear(N);
+        return;
+    }
+
+    if (level <= rs->chunk_level) {
+        #pragma omp parallel default(none) shared(N, level, rs)
+        #pragma omp single
+        radix_convert(N, level, rs->chunk, rs->powers);
+
+        size_t skip = rs->skip < width ? rs->skip : width;
+        rs->skip -= skip;
+        rs->sink(rs->chunk + skip, width - skip, rs->arg);
+        return;
+    }
+
+    mpz_t q, r;
+    mpz_inits(q, r, NULL);
+    mpz_tdiv_qr(q, r, N, rs->powers[level - 1]);
+    mpz_clear(N);
+
+    radix_stream_field(q, level - 1, rs);
+    radix_stream_field(r, level - 1, rs);
+}
+
+// Stream the n_digits digits of N to sink in pieces of at most chunk_digits digits
+int radix_stream(mpz_t N, size_t n_digits, size_t chunk_digits, radix_sink_fn sink, void* arg) {
+    int levels = radix_levels(n_digits);
+    size_t width = (size_t) RADIX_LEAF_DIGITS << levels;
+
+    // Largest field level that fits in a chunk (a chunk holds at least one leaf)
+    int chunk_level = 0;
+    while (chunk_level < levels && ((size_t) RADIX_LEAF_DIGITS << (chunk_level + 1)) <= chunk_digits) {
+        chunk_level++;
+    }
+
+    mpz_t* powers = radix_powers(levels);
+    char* chunk = (char*) malloc((size_t) RADIX_LEAF_DIGITS << chunk_level);
+    if (!powers || !chunk) {
+        if (powers) radix_clear_powers(powers, levels);
+        free(chunk);
+        mpz_clear(N);
+        return -1;
+    }
+
+    RadixStream rs = { (const mpz_t*) powers, chunk_level, chunk, width - n_digits, sink, arg };
+    radix_stream_field(N, levels, &rs);
+
+    free(chunk);
+    radix_clear_powers(powers, levels);
+    return 0;
+}
+
+// Decimal digits covering n_digits digits of another radix, plus guard digits
+size_t radix_decimal_digits(size_t n_digits, int radix) {
+    if (radix == 10) return n_digits;
+    return (size_t) ceil((double) n_digits * log10((double) radix)) + 2;
+}
+
+// Stream the fractional digits of x in radix 2 or 16
+int radix_stream_pow2(const mpf_t x, int radix, size_t n_digits, size_t chunk_digits, radix_sink_fn sink, void* arg) {
+    static const char hex[] = "0123456789ABCDEF";
+    int bits = radix == 2 ? 1 : 4;
+    mp_limb_t mask = ((mp_limb_t) 1 << bits) - 1;
+
+    // N = floor(x * radix^n_digits); digit i after the point sits at bit (n_digits - 1 - i) * bits
+    mpf_t scaled;
+    mpz_t N;
+    mpf_init2(scaled, mpf_get_prec(x));
+    mpf_mul_2exp(scaled, x, (mp_bitcnt_t) n_digits * bits);
+    mpz_init(N);
+    mpz_set_f(N, scaled);
+    mpf_clear(scaled);
+
+    if (chunk_digits > n_digits) chunk_digits = n_digits;
+    char* chunk = (char*) malloc(chunk_digits > 0 ? chunk_digits : 1);
+    if (!chunk) {
+        mpz_clear(N);
+        return -1;
+    }
+
+    size_t bit = n_digits * bits;
+    for (size_t done = 0; done < n_digits; ) {
+        size_t len = n_digits - done < chunk_digits ? n_digits - done : chunk_digits;
+        for (size_t i = 0; i < len; i++) {
+            bit -= bits;
+            mp_limb_t limb = mpz_getlimbn(N, (mp_size_t) (bit / GMP_NUMB_BITS));
+            chunk[i] = hex[(limb >> (bit % GMP_NUMB_BITS)) & mask];
+        }
+        sink(chunk, len, arg);
+        done += len;
+    }
+
+    free(chunk);
+    mpz_clear(N);
+    return 0;
+}
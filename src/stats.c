@@ -0,0 +1,149 @@
+// Per-phase timing and throughput of a run, written as JSON for --stats.
+//
+// Phase times are added by the main thread around each phase. In the series loop
+// every worker reports its own busy time per block, and the time it then waited at
+// the barrier for the slowest worker, so the report shows the load imbalance of the
+// chosen schedule and thread count.
+
+#include "stats.h"
+#include <stdlib.h>
+
+// One series block
+typedef struct {
+    unsigned long start_k, end_k;
+    double series, reduction;
+} StatsBlock;
+
+// Totals of one worker
+typedef struct {
+    double busy, idle;
+    unsigned long long terms;
+} StatsThread;
+
+static bool stats_active = false;
+static int stats_threads = 0;
+static double phase_time[STATS_PHASES];
+static StatsThread* thread_stats = NULL;
+static StatsBlock* blocks = NULL;
+static int block_count = 0, block_capacity = 0;
+static unsigned long long output_bytes = 0;
+
+static unsigned long run_digits = 0;
+static const char* run_algorithm = "";
+static const char* run_schedule = "";
+static int run_chunk_size = 0;
+
+static const char* phase_names[STATS_PHASES] = {
+    "setup", "checkpoint_load", "series", "reduction", "checkpoint_save", "division", "conversion", "write"
+};
+
+// Collect per-phase statistics for a run with num_threads threads
+int stats_enable(int num_threads) {
+    if (num_threads <= 0) num_threads = 1;
+    thread_stats = (StatsThread*) calloc(num_threads, sizeof(StatsThread));
+    if (!thread_stats) return -1;
+    stats_threads = num_threads;
+    stats_active = true;
+    return 0;
+}
+
+// Whether stats_enable succeeded
+bool stats_enabled(void) {
+    return stats_active;
+}
+
+void stats_set_run(unsigned long digits, const char* algorithm, const char* schedule, int chunk_size) {
+    run_digits = digits;
+    run_algorithm = algorithm;
+    run_schedule = schedule;
+    run_chunk_size = chunk_size;
+}
+
+void stats_add_time(StatsPhase phase, double seconds) {
+    if (stats_active) phase_time[phase] += seconds;
+}
+
+void stats_add_block(unsigned long start_k, unsigned long end_k, double series, double reduction) {
+    if (!stats_active) return;
+    if (block_count == block_capacity) {
+        int capacity = block_capacity ? 2 * block_capacity : 64;
+        StatsBlock* grown = (StatsBlock*) realloc(blocks, capacity * sizeof(StatsBlock));
+        if (!grown) return; // The report just misses the block
+        blocks = grown;
+        block_capacity = capacity;
+    }
+    StatsBlock* block = &blocks[block_count++];
+    block->start_k = start_k;
+    block->end_k = end_k;
+    block->series = series;
+    block->reduction = reduction;
+}
+
+// Called by each worker for its own slot
+void stats_add_thread(int tid, double busy, double idle, unsigned long terms) {
+    if (!stats_active || tid >= stats_threads) return;
+    thread_stats[tid].busy += busy;
+    thread_stats[tid].idle += idle;
+    thread_stats[tid].terms += terms;
+}
+
+void stats_add_output(unsigned long long bytes) {
+    if (stats_active) output_bytes += bytes;
+}
+
+// Rate per second, 0 if the time is too small to measure
+static double rate(double amount, double seconds) {
+    return seconds > 0 ? amount / seconds : 0;
+}
+
+// Write the report as JSON
+int stats_write_json(const char* filename, double total_time) {
+    FILE* out = fopen(filename, "w");
+    if (!out) return -1;
+
+    fprintf(out, "{\n  \"run\": {\"digits\": %lu, \"algorithm\": \"%s\", \"threads\": %d, "
+            "\"schedule\": \"%s\", \"chunk_size\": %d},\n",
+            run_digits, run_algorithm, stats_threads, run_schedule, run_chunk_size);
+    fprintf(out, "  \"total_s\": %.6f,\n  \"phases_s\": {", total_time);
+    for (int p = 0; p < STATS_PHASES; p++) {
+        fprintf(out, "%s\"%s\": %.6f", p ? ", " : "", phase_names[p], phase_time[p]);
+    }
+    fprintf(out, "},\n");
+
+    // Load balance of the series loop: the slowest worker against the average one
+    double busy_sum = 0, busy_max = 0, idle_sum = 0;
+    for (int t = 0; t < stats_threads; t++) {
+        busy_sum += thread_stats[t].busy;
+        idle_sum += thread_stats[t].idle;
+        if (thread_stats[t].busy > busy_max) busy_max = thread_stats[t].busy;
+    }
+    double busy_avg = busy_sum / stats_threads;
+    fprintf(out, "  \"load_balance\": {\"busy_max_s\": %.6f, \"busy_avg_s\": %.6f, \"idle_total_s\": %.6f, "
+            "\"imbalance\": %.4f},\n",
+            busy_max, busy_avg, idle_sum, busy_avg > 0 ? busy_max / busy_avg - 1 : 0);
+
+    // Terms evaluated in this run (not those recovered from a checkpoint)
+    unsigned long long terms = 0;
+    for (int b = 0; b < block_count; b++) {
+        terms += blocks[b].end_k - blocks[b].start_k;
+    }
+    fprintf(out, "  \"throughput\": {\"terms_per_s\": %.1f, \"conversion_digits_per_s\": %.1f, "
+            "\"write_MB_per_s\": %.2f, \"output_bytes\": %llu},\n",
+            rate((double) terms, phase_time[STATS_SERIES]),
+            rate((double) run_digits, phase_time[STATS_CONVERSION]),
+            rate(output_bytes / 1048576.0, phase_time[STATS_WRITE]), output_bytes);
+
+    fprintf(out, "  \"threads\": [");
+    for (int t = 0; t < stats_threads; t++) {
+        fprintf(out, "%s\n    {\"id\": %d, \"busy_s\": %.6f, \"idle_s\": %.6f, \"terms\": %llu}",
+                t ? "," : "", t, thread_stats[t].busy, thread_stats[t].idle, thread_stats[t].terms);
+    }
+    fprintf(out, "\n  ],\n  \"blocks\": [");
+    for (int b = 0; b < block_count; b++) {
+        fprintf(out, "%s\n    {\"start_k\": %lu, \"end_k\": %lu, \"series_s\": %.6f, \"reduction_s\": %.6f}",
+                b ? "," : "", blocks[b].start_k, blocks[b].end_k, blocks[b].series, blocks[b].reduction);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,223 @@
+// Out-of-core storage for the largest operands of a computation.
+//
+// Integers are written to the swap directory as raw native limbs in large
+// sequential blocks. swap_mul multiplies a spilled integer by one in memory
+// without loading the former: each block a_i of a is multiplied by b and
+// added into the result at the block's offset, so only one block of a is
+// resident at a time.
+
+#include "swap.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+#define SWAP_BLOCK_LIMBS ((size_t) 1 << 23)  // 64 MB per sequential read/write with 64-bit limbs
+
+static char* swap_dir = NULL;                 // Directory for spill files (NULL = disabled)
+static unsigned long swap_file_count = 0;     // Used to build unique file names
+static unsigned long long swap_bytes_written = 0;
+static unsigned long long swap_bytes_read = 0;
+
+// Enable out-of-core storage in the given directory
+int swap_init(const char* dir) {
+    free(swap_dir);
+    swap_dir = (char*) malloc(strlen(dir) + 1);
+    if (!swap_dir) return -1;
+    strcpy(swap_dir, dir);
+
+    // Check that the directory is writable
+    SwapInt probe;
+    mpz_t zero;
+    mpz_init(zero);
+    int ret = swap_out(&probe, zero);
+    if (ret == 0) swap_release(&probe);
+    mpz_clear(zero);
+    if (ret != 0) {
+        free(swap_dir);
+        swap_dir = NULL;
+    }
+    return ret;
+}
+
+// Whether swap_init succeeded
+bool swap_enabled(void) {
+    return swap_dir != NULL;
+}
+
+// Write x to disk in large sequential blocks and release its memory
+int swap_out(SwapInt* s, mpz_t x) {
+    unsigned long id;
+    #pragma omp atomic capture
+    id = swap_file_count++;
+
+    size_t path_len = strlen(swap_dir) + 64;
+    s->path = (char*) malloc(path_len);
+    if (!s->path) return -1;
+    snprintf(s->path, path_len, "%s/pi_swap_%ld_%lu.bin", swap_dir, (long) getpid(), id);
+    s->sign = mpz_sgn(x);
+    s->limbs = mpz_size(x);
+
+    FILE* fp = fopen(s->path, "wb");
+    if (!fp) {
+        perror("Failed to create swap file");
+        free(s->path);
+        s->path = NULL;
+        return -1;
+    }
+
+    const mp_limb_t* limbs = mpz_limbs_read(x);
+    for (size_t done = 0; done < s->limbs; done += SWAP_BLOCK_LIMBS) {
+        size_t n = s->limbs - done < SWAP_BLOCK_LIMBS ? s->limbs - done : SWAP_BLOCK_LIMBS;
+        if (fwrite(limbs + done, sizeof(mp_limb_t), n, fp) != n) {
+            perror("Failed to write swap file");
+            fclose(fp);
+            swap_release(s);
+            return -1;
+        }
+    }
+    if (fclose(fp) != 0) {
+        perror("Failed to write swap file");
+        swap_release(s);
+        return -1;
+    }
+
+    #pragma omp atomic
+    swap_bytes_written += s->limbs * sizeof(mp_limb_t);
+
+    // Release the memory of x
+    mpz_clear(x);
+    mpz_init(x);
+    return 0;
+}
+
+// Read the next n limbs of a spilled integer
+static int swap_read(FILE* fp, mp_limb_t* dst, size_t n) {
+    if (fread(dst, sizeof(mp_limb_t), n, fp) != n) {
+        perror("Failed to read swap file");
+        return -1;
+    }
+
+    #pragma omp atomic
+    swap_bytes_read += n * sizeof(mp_limb_t);
+    return 0;
+}
+
+// Read a spilled integer back into x
+int swap_in(mpz_t x, const SwapInt* s) {
+    if (s->limbs == 0) {
+        mpz_set_ui(x, 0);
+        return 0;
+    }
+
+    FILE* fp = fopen(s->path, "rb");
+    if (!fp) {
+        perror("Failed to open swap file");
+        return -1;
+    }
+
+    mp_limb_t* limbs = mpz_limbs_write(x, s->limbs);
+    for (size_t done = 0; done < s->limbs; done += SWAP_BLOCK_LIMBS) {
+        size_t n = s->limbs - done < SWAP_BLOCK_LIMBS ? s->limbs - done : SWAP_BLOCK_LIMBS;
+        if (swap_read(fp, limbs + done, n) != 0) {
+            fclose(fp);
+            mpz_set_ui(x, 0);
+            return -1;
+        }
+    }
+    fclose(fp);
+
+    mpz_limbs_finish(x, s->sign < 0 ? -(mp_size_t) s->limbs : (mp_size_t) s->limbs);
+    return 0;
+}
+
+// rop = a * b, streaming a from disk one block at a time
+int swap_mul(mpz_t rop, const SwapInt* a, const mpz_t b) {
+    size_t nb = mpz_size(b);
+    if (a->limbs == 0 || nb == 0) {
+        mpz_set_ui(rop, 0);
+        return 0;
+    }
+
+    FILE* fp = fopen(a->path, "rb");
+    if (!fp) {
+        perror("Failed to open swap file");
+        return -1;
+    }
+
+    size_t block = a->limbs < SWAP_BLOCK_LIMBS ? a->limbs : SWAP_BLOCK_LIMBS;
+    mp_limb_t* a_block = (mp_limb_t*) malloc(block * sizeof(mp_limb_t));
+    mp_limb_t* product = (mp_limb_t*) malloc((block + nb) * sizeof(mp_limb_t));
+    if (!a_block || !product) {
+        free(a_block);
+        free(product);
+        fclose(fp);
+        return -1;
+    }
+
+    size_t nr = a->limbs + nb;
+    mp_limb_t* r = mpz_limbs_write(rop, nr);
+    const mp_limb_t* bp = mpz_limbs_read(b);
+    memset(r, 0, nr * sizeof(mp_limb_t));
+
+    int ret = 0;
+    for (size_t done = 0; done < a->limbs; done += block) {
+        size_t n = a->limbs - done < block ? a->limbs - done : block;
+        if (swap_read(fp, a_block, n) != 0) {
+            ret = -1;
+            break;
+        }
+
+        // r[done ..] += a_block * b (mpn_mul wants the longer operand first)
+        if (n >= nb) {
+            mpn_mul(product, a_block, n, bp, nb);
+        } else {
+            mpn_mul(product, bp, nb, a_block, n);
+        }
+        mpn_add(r + done, r + done, nr - done, product, n + nb);
+    }
+
+    free(a_block);
+    free(product);
+    fclose(fp);
+
+    if (ret != 0) {
+        mpz_set_ui(rop, 0);
+        return ret;
+    }
+
+    mp_size_t size = (mp_size_t) nr;
+    if (a->sign * mpz_sgn(b) < 0) size = -size;
+    mpz_limbs_finish(rop, size);
+    return 0;
+}
+
+// Delete the file behind a spilled integer
+void swap_release(SwapInt* s) {
+    if (!s->path) return;
+    remove(s->path);
+    free(s->path);
+    s->path = NULL;
+}
+
+// Print the bytes moved to and from disk and the peak resident memory of the process
+void swap_report(FILE* out) {
+    fprintf(out, "Out-of-core I/O: %.1f MB written, %.1f MB read\n",
+            swap_bytes_written / 1048576.0, swap_bytes_read / 1048576.0);
+    #ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        #ifdef __APPLE__
+        double peak_mb = usage.ru_maxrss / 1048576.0;   // Bytes on macOS
+        #else
+        double peak_mb = usage.ru_maxrss / 1024.0;      // Kilobytes on Linux
+        #endif
+        fprintf(out, "Peak RAM: %.1f MB\n", peak_mb);
+    }
+    #endif
+}
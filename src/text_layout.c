@@ -0,0 +1,146 @@
+// Parallel formatted output with positioned writes.
+//
+// Digit i of the formatted layout is preceded by i digits and (i - 1) / 10 separators, so a range
+// of digits can be formatted and written without knowing anything about the others. The range is
+// cut into one slice of whole lines per thread; each thread formats its slice buffer by buffer
+// and writes it with pwrite at its own offset, so no thread waits for another and the stream's
+// file position is only moved once at the end.
+
+#include "text_layout.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#define TEXT_LAYOUT_LINE 100                    // Digits per line
+#define TEXT_LAYOUT_MIN_SLICE (1 << 16)         // Fewer digits per thread are not worth a thread
+
+// Bytes taken by the first index digits
+uint64_t text_layout_offset(uint64_t index) {
+    return index == 0 ? 0 : index + (index - 1) / 10;
+}
+
+// Format digits first .. first + len - 1 into out; returns the bytes written
+static size_t text_layout_format(char* out, const char* digits, size_t len, uint64_t first) {
+    size_t n = 0;
+    while (len > 0) {
+        if (first > 0 && first % 10 == 0) {
+            out[n++] = first % TEXT_LAYOUT_LINE == 0 ? '\n' : ' ';
+        }
+        size_t block_length = 10 - first % 10;
+        if (block_length > len) block_length = len;
+        memcpy(out + n, digits, block_length);
+        n += block_length;
+        digits += block_length;
+        first += block_length;
+        len -= block_length;
+    }
+    return n;
+}
+
+#ifndef _WIN32
+// pwrite all of buffer, continuing after short writes
+static int text_layout_write_all(int fd, const char* buffer, size_t size, int64_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, buffer, size, (off_t) offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buffer += written;
+        size -= (size_t) written;
+        offset += written;
+    }
+    return 0;
+}
+#endif
+
+// Start of the layout in a regular file
+int64_t text_layout_begin(FILE* stream) {
+    #ifdef _WIN32
+    (void) stream;
+    return -1;
+    #else
+    struct stat st;
+    if (fflush(stream) != 0 || fstat(fileno(stream), &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    off_t position = ftello(stream);
+    return position < 0 ? -1 : (int64_t) position;
+    #endif
+}
+
+// Format and pwrite a range of digits
+int64_t text_layout_pwrite(FILE* stream, int64_t base, const char* digits, size_t len, uint64_t first,
+    size_t buffer_size) {
+    #ifdef _WIN32
+    (void) stream; (void) base; (void) digits; (void) len; (void) first; (void) buffer_size;
+    errno = ENOSYS;
+    return -1;
+    #else
+    int fd = fileno(stream);
+    uint64_t end = first + len;
+
+    // Digits per buffer: whole lines of 110 bytes (a buffer holds at least 1024 bytes)
+    size_t buffer_digits = buffer_size / 110 * TEXT_LAYOUT_LINE;
+    if (buffer_digits == 0) buffer_digits = TEXT_LAYOUT_LINE;
+
+    int threads = omp_get_max_threads();
+    if ((size_t) threads > len / TEXT_LAYOUT_MIN_SLICE) threads = (int) (len / TEXT_LAYOUT_MIN_SLICE);
+    if (threads < 1) threads = 1;
+    int failed = 0;
+
+    #pragma omp parallel num_threads(threads) default(none) \
+        shared(fd, base, digits, first, end, buffer_digits, failed)
+    {
+        int t = omp_get_thread_num();
+        int team = omp_get_num_threads();
+
+        // Slice boundaries rounded to line starts, so only the first and last slice hold partial lines
+        uint64_t lines_begin = first / TEXT_LAYOUT_LINE, lines_end = (end + TEXT_LAYOUT_LINE - 1) / TEXT_LAYOUT_LINE;
+        uint64_t lines = lines_end - lines_begin;
+        uint64_t slice_begin = (lines_begin + lines * t / team) * TEXT_LAYOUT_LINE;
+        uint64_t slice_end = (lines_begin + lines * (t + 1) / team) * TEXT_LAYOUT_LINE;
+        if (slice_begin < first) slice_begin = first;
+        if (slice_end > end) slice_end = end;
+
+        char* buffer = slice_begin < slice_end ? (char*) malloc(buffer_digits + buffer_digits / 10 + 1) : NULL;
+        if (slice_begin < slice_end && !buffer) {
+            #pragma omp atomic write
+            failed = ENOMEM;
+        }
+        for (uint64_t position = slice_begin; buffer && position < slice_end; ) {
+            // Up to the next buffer boundary, so that later buffers start on a line
+            uint64_t stop = (position / buffer_digits + 1) * buffer_digits;
+            if (stop > slice_end) stop = slice_end;
+            size_t size = text_layout_format(buffer, digits + (position - first), (size_t) (stop - position), position);
+            if (text_layout_write_all(fd, buffer, size, base + (int64_t) text_layout_offset(position)) != 0) {
+                #pragma omp atomic write
+                failed = errno;
+                break;
+            }
+            position = stop;
+        }
+        free(buffer);
+    }
+
+    if (failed) {
+        errno = failed;
+        return -1;
+    }
+    return (int64_t) (text_layout_offset(end) - text_layout_offset(first));
+    #endif
+}
+
+// Position stream after the written layout
+int text_layout_end(FILE* stream, int64_t base, uint64_t digits) {
+    #ifdef _WIN32
+    (void) stream; (void) base; (void) digits;
+    return 0;
+    #else
+    return fseeko(stream, (off_t) (base + (int64_t) text_layout_offset(digits)), SEEK_SET) == 0 ? 0 : -1;
+    #endif
+}
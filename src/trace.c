@@ -0,0 +1,128 @@
+// Timeline of the run in Chrome trace-event format, for --trace.
+//
+// Every thread appends its spans to its own buffer, registered the first time it
+// records (the only lock taken), so recording never contends. The buffers are
+// written at the end as complete ("X") events, one track per thread, and open in
+// chrome://tracing or ui.perfetto.dev. When tracing is off the callers skip even
+// the timestamps, so nothing is recorded and nothing is allocated.
+
+#include "trace.h"
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+// One recorded span
+typedef struct {
+    const char* name;
+    double start, end;
+    unsigned long k_begin, k_end;
+} TraceEvent;
+
+// Spans of one thread
+typedef struct TraceThread {
+    TraceEvent* events;
+    size_t count, capacity;
+    int id;                     // Track number in the trace
+    char name[32];
+    struct TraceThread* next;
+} TraceThread;
+
+static bool trace_active = false;
+static double trace_origin = 0;
+static TraceThread* trace_threads = NULL;   // All registered threads, newest first
+static int trace_thread_count = 0;
+static TRACE_THREAD_LOCAL TraceThread* trace_self = NULL;
+
+// Buffer of the calling thread, registered on first use. NULL if it cannot be allocated
+static TraceThread* trace_thread(void) {
+    if (trace_self) return trace_self;
+
+    TraceThread* self = (TraceThread*) calloc(1, sizeof(TraceThread));
+    if (!self) return NULL;
+
+    #pragma omp critical (trace_register)
+    {
+        self->id = trace_thread_count++;
+        self->next = trace_threads;
+        trace_threads = self;
+    }
+
+    // The main thread registers in trace_enable; OpenMP workers by their thread number
+    if (self->id == 0) {
+        snprintf(self->name, sizeof(self->name), "main");
+    } else if (omp_in_parallel()) {
+        snprintf(self->name, sizeof(self->name), "OpenMP thread %d", omp_get_thread_num());
+    } else {
+        snprintf(self->name, sizeof(self->name), "thread %d", self->id);
+    }
+
+    trace_self = self;
+    return self;
+}
+
+// Record spans for a Chrome / Perfetto trace
+int trace_enable(void) {
+    trace_origin = omp_get_wtime();
+    if (!trace_thread()) return -1;
+    trace_active = true;
+    return 0;
+}
+
+// Whether trace_enable succeeded
+bool trace_enabled(void) {
+    return trace_active;
+}
+
+// Record a span on the calling thread
+void trace_span(const char* name, double start, double end, unsigned long k_begin, unsigned long k_end) {
+    if (!trace_active) return;
+    TraceThread* self = trace_thread();
+    if (!self) return; // A thread without a buffer records nothing
+    if (self->count == self->capacity) {
+        size_t capacity = self->capacity ? 2 * self->capacity : 1024;
+        TraceEvent* grown = (TraceEvent*) realloc(self->events, capacity * sizeof(TraceEvent));
+        if (!grown) return; // The trace just misses the span
+        self->events = grown;
+        self->capacity = capacity;
+    }
+    TraceEvent* event = &self->events[self->count++];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    event->k_begin = k_begin;
+    event->k_end = k_end;
+}
+
+// Write all spans in trace-event format (microseconds)
+int trace_write(const char* filename) {
+    FILE* out = fopen(filename, "w");
+    if (!out) return -1;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+            "\"args\": {\"name\": \"pi_calculator\"}}");
+    for (TraceThread* t = trace_threads; t; t = t->next) {
+        fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s\"}}", t->id, t->name);
+        fprintf(out, ",\n{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"sort_index\": %d}}", t->id, t->id);
+        for (size_t i = 0; i < t->count; i++) {
+            const TraceEvent* e = &t->events[i];
+            fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                    e->name, t->id, (e->start - trace_origin) * 1e6, (e->end - e->start) * 1e6);
+            if (e->k_end > e->k_begin) {
+                fprintf(out, ", \"args\": {\"k_begin\": %lu, \"k_end\": %lu}", e->k_begin, e->k_end);
+            }
+            fprintf(out, "}");
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}